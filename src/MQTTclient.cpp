@@ -6,9 +6,12 @@
  * @date 2022-05-29
 **/
 
+#define LOG_MODULE LOG_MOD_MQTT
 #include "log.h"
 
 #include "MQTTclient.h"
+#include "metrics.h"
+#include "energy.h"
 
 bool enableMqtt = false;                    // Enable Mqtt, disable to reduce power consumtion, stored in NVS
 
@@ -61,6 +64,7 @@ void MQTTclient::connect() {
     LOG_INFO_LN(F("[MQTT] disabled!"));
   } else {
     LOG_INFO_LN(F("[MQTT] Connecting to MQTT..."));
+    metricMqttReconnects.inc();
     client.connect(
       mqttClientId.c_str(),
       mqttUser.length() > 0 ? mqttUser.c_str() : NULL,
@@ -75,13 +79,13 @@ void MQTTclient::connect() {
 
     switch (client.state()) {
     case MQTT_CONNECTION_TIMEOUT:
-      LOG_INFO_LN(F("[MQTT] ... connection time out"));
+      LOG_WARN_LN(F("[MQTT] ... connection time out"));
       break;
     case MQTT_CONNECTION_LOST:
-      LOG_INFO_LN(F("[MQTT] ... connection lost"));
+      LOG_WARN_LN(F("[MQTT] ... connection lost"));
       break;
     case MQTT_CONNECT_FAILED:
-      LOG_INFO_LN(F("[MQTT] ... connection failed"));
+      LOG_WARN_LN(F("[MQTT] ... connection failed"));
       break;
     case MQTT_DISCONNECTED:
       LOG_INFO_LN(F("[MQTT] ... disconnected"));
@@ -90,23 +94,22 @@ void MQTTclient::connect() {
       LOG_INFO_LN(F("[MQTT] ... connected"));
       break;
     case MQTT_CONNECT_BAD_PROTOCOL:
-      LOG_INFO_LN(F("[MQTT] ... connection error: bad protocol"));
+      LOG_WARN_LN(F("[MQTT] ... connection error: bad protocol"));
       break;
     case MQTT_CONNECT_BAD_CLIENT_ID:
-      LOG_INFO_LN(F("[MQTT] ... connection error: bad client ID"));
+      LOG_WARN_LN(F("[MQTT] ... connection error: bad client ID"));
       break;
     case MQTT_CONNECT_UNAVAILABLE:
-      LOG_INFO_LN(F("[MQTT] ... connection error: unavailable"));
+      LOG_WARN_LN(F("[MQTT] ... connection error: unavailable"));
       break;
     case MQTT_CONNECT_BAD_CREDENTIALS:
-      LOG_INFO_LN(F("[MQTT] ... connection error: bad credentials"));
+      LOG_WARN_LN(F("[MQTT] ... connection error: bad credentials"));
       break;
     case MQTT_CONNECT_UNAUTHORIZED:
-      LOG_INFO_LN(F("[MQTT] ... connection error: unauthorized"));
+      LOG_WARN_LN(F("[MQTT] ... connection error: unauthorized"));
       break;
     default:
-      LOG_INFO(F("[MQTT] ... connection error: unknown code "));
-      LOG_INFO_LN(client.state());
+      LOG_WARN_F("[MQTT] ... connection error: unknown code %d\n", client.state());
       break;
     }
   }
@@ -114,3 +117,13 @@ void MQTTclient::connect() {
 void MQTTclient::disconnect() {
   client.disconnect();
 }
+
+bool MQTTclient::publish(const String &subtopic, const String &payload, bool retained) {
+  EnergyScope energy(ENERGY_MQTT);
+  if (client.publish((mqttTopic + subtopic).c_str(), payload.c_str(), retained)) {
+    metricMqttPublishes.inc();
+    return true;
+  }
+  metricMqttPublishFailures.inc();
+  return false;
+}
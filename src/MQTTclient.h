@@ -35,6 +35,9 @@ class MQTTclient {
         void connect();
         void disconnect();
 
+        // Publish a message below mqttTopic
+        bool publish(const String &subtopic, const String &payload, bool retained = true);
+
         PubSubClient client;
     private:
         WiFiClient ethClient;
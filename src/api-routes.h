@@ -16,9 +16,17 @@
 #include <ESPAsyncWebServer.h>
 #include <FS.h>
 #include <LittleFS.h>
+#include <memory>
 #include "ble.h"
 #include <Update.h>
 #include <esp_ota_ops.h>
+#include "metrics.h"
+#include "config.h"
+#include "logfile.h"
+#include "history.h"
+#include "telemetry.h"
+#include "energy.h"
+#include "boot.h"
 
 extern bool enableWifi;
 extern bool enableBle;
@@ -34,8 +42,90 @@ uint8_t temprature_sens_read();
 #endif
 uint8_t temprature_sens_read();
 
+// Values of /api/esp that never change at runtime, as JSON members without the surrounding braces.
+// Computed on first use, as ESP.getSketchMD5() and ESP.getSketchSize() have to read the whole app image.
+const String &espStaticInfo() {
+  static String cache;
+  if (!cache.isEmpty()) return cache;
+
+  DynamicJsonDocument json(1024);
+
+  JsonObject booting = json.createNestedObject("booting");
+  booting["rebootReason"] = esp_reset_reason();
+  booting["partitionCount"] = esp_ota_get_app_partition_count();
+
+  auto partition = esp_ota_get_running_partition();
+  JsonObject runningPartition = json.createNestedObject("runningPartition");
+  runningPartition["address"] = partition->address;
+  runningPartition["size"] = partition->size;
+  runningPartition["label"] = partition->label;
+  runningPartition["encrypted"] = partition->encrypted;
+  switch (partition->type) {
+    case ESP_PARTITION_TYPE_APP:  runningPartition["type"] = "app"; break;
+    case ESP_PARTITION_TYPE_DATA: runningPartition["type"] = "data"; break;
+    default: runningPartition["type"] = "any";
+  }
+  runningPartition["subtype"] = partition->subtype;
+
+  JsonObject build = json.createNestedObject("build");
+  build["date"] = __DATE__;
+  build["time"] = __TIME__;
+
+  JsonObject flash = json.createNestedObject("flash");
+  flash["flashChipSize"] = ESP.getFlashChipSize();
+  flash["flashChipRealSize"] = spi_flash_get_chip_size();
+  flash["flashChipSpeedMHz"] = ESP.getFlashChipSpeed() / 1000000;
+  flash["flashChipMode"] = ESP.getFlashChipMode();
+  flash["sdkVersion"] = ESP.getFlashChipSize();
+
+  JsonObject sketch = json.createNestedObject("sketch");
+  sketch["size"] = ESP.getSketchSize();
+  sketch["maxSize"] = ESP.getFreeSketchSpace();
+  sketch["usagePercent"] = (float)ESP.getSketchSize() / (float)ESP.getFreeSketchSpace() * 100.f;
+  sketch["md5"] = ESP.getSketchMD5();
+
+  serializeJson(json, cache);
+  cache = cache.substring(1, cache.length() - 1);
+  return cache;
+}
+
+// Recording of the raw readings of a scale (1 based)
+String recordingPath(uint8_t scale) {
+  return String(RECORDING_DIR) + "/scale" + String(scale) + ".bin";
+}
+
+// Size a new recording of a scale may grow to. It replaces the last recording of the scale,
+// the log segments and the history keep the room to grow to their full size.
+size_t recordingSpace(uint8_t scale) {
+  size_t reserved = LOGFILE_SEGMENTS * LOGFILE_SEGMENT_SIZE + HISTORY_SEGMENTS * HISTORY_SEGMENT_RECORDS * sizeof(HistoryRecord);
+  size_t available = LittleFS.totalBytes() - LittleFS.usedBytes();
+  File previous = LittleFS.open(recordingPath(scale), FILE_READ);
+  if (previous) available += previous.size();
+  previous.close();
+  return available > reserved ? min(available - reserved, (size_t)RECORDING_MAX_SIZE) : 0;
+}
+
+// Register a route, each request is timed in the metrics and accounted to the web subsystem
+void apiRoute(const char * uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+  webServer.on(uri, method, [onRequest](AsyncWebServerRequest *request) {
+    MetricTimer timer(metricHttpRequestDuration);
+    EnergyScope energy(ENERGY_WEB);
+    onRequest(request);
+  });
+}
+
+// Same for a request with a body, onBody is called for every received part of it
+void apiRoute(const char * uri, WebRequestMethodComposite method, ArBodyHandlerFunction onBody) {
+  webServer.on(uri, method, [](AsyncWebServerRequest * request){}, NULL,
+    [onBody](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
+    MetricTimer timer(metricHttpRequestDuration);
+    EnergyScope energy(ENERGY_WEB);
+    onBody(request, data, len, index, total);
+  });
+}
+
 void APIRegisterRoutes() {
-  webServer.on("/api/firmware/info", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/firmware/info", HTTP_GET, [&](AsyncWebServerRequest *request) {
     auto data = esp_ota_get_running_partition();
     String output;
     DynamicJsonDocument doc(256);
@@ -59,7 +149,7 @@ void APIRegisterRoutes() {
   });
   webServer.addHandler(&events);
 
-  webServer.on("/api/reset", HTTP_POST, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/reset", HTTP_POST, [&](AsyncWebServerRequest *request) {
     AsyncResponseStream *response = request->beginResponseStream("application/json");
     request->send(200, "application/json", "{\"message\":\"Resetting the sensor!\"}");
     request->send(response);
@@ -68,101 +158,100 @@ void APIRegisterRoutes() {
     ESP.restart();
   });
 
-  webServer.on("/api/config", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  apiRoute("/api/config", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
       
     DynamicJsonDocument jsonBuffer(1024);
     deserializeJson(jsonBuffer, (const char*)data);
 
-    if (preferences.begin(NVS_NAMESPACE)) {
-      String hostname = jsonBuffer["hostname"].as<String>();
-      if (!hostname || hostname.length() < 3 || hostname.length() > 32) {
-        // TODO: Add better checks according to RFC hostnames
-        request->send(422, "application/json", "{\"message\":\"Invalid hostname!\"}");
-        return;
-      } else {
-        preferences.putString("hostname", hostname);
-      }
-
-      if (preferences.putBool("enableWifi", jsonBuffer["enableWifi"].as<boolean>())) {
-        enableWifi = jsonBuffer["enableWifi"].as<boolean>();
-      }
-      if (preferences.putBool("enableSoftAp", jsonBuffer["enableSoftAp"].as<boolean>())) {
-        WifiManager.fallbackToSoftAp(jsonBuffer["enableSoftAp"].as<boolean>());
-      }
+    // Missing values keep their current setting
+    const ConfigData previous = Config.get();
+    ConfigData updated = previous;
+    auto readString = [&](const char * key, String &value) {
+      if (jsonBuffer[key].is<const char*>()) value = jsonBuffer[key].as<String>();
+    };
+    readString("hostname", updated.hostname);
+    updated.enableWifi = jsonBuffer["enableWifi"] | updated.enableWifi;
+    updated.enableSoftAp = jsonBuffer["enableSoftAp"] | updated.enableSoftAp;
+    updated.enableBle = jsonBuffer["enableBle"] | updated.enableBle;
+    updated.enableBleBroadcast = jsonBuffer["enableBleBroadcast"] | updated.enableBleBroadcast;
+    updated.enableDac = jsonBuffer["enableDac"] | updated.enableDac;
+    readString("otaPassword", updated.otaPassword);
+    updated.otaWebEnabled = jsonBuffer["otaWebEnabled"] | updated.otaWebEnabled;
+    readString("otaWebUrl", updated.otaWebUrl);
+    updated.enableMqtt = jsonBuffer["enableMqtt"] | updated.enableMqtt;
+    readString("mqttHost", updated.mqttHost);
+    updated.mqttPort = jsonBuffer["mqttPort"] | updated.mqttPort;
+    readString("mqttTopic", updated.mqttTopic);
+    readString("mqttUser", updated.mqttUser);
+    readString("mqttPass", updated.mqttPass);
+
+    String error;
+    if (!Config.commit(updated, error)) {
+      request->send(422, "application/json", "{\"message\":\"" + error + "\"}");
+      return;
+    }
 
-      if (preferences.putBool("enableBle", jsonBuffer["enableBle"].as<boolean>())) {
-        if (enableBle) stopBleServer();
-        enableBle = jsonBuffer["enableBle"].as<boolean>();
-        if (enableBle) createBleServer(hostname);
-        yield();
-      }
-      if (preferences.putBool("enableDac", jsonBuffer["enableDac"].as<boolean>())) {
-        enableDac = jsonBuffer["enableDac"].as<boolean>();
-      }
+    // Apply what is possible without a reboot
+    enableWifi = updated.enableWifi;
+    if (updated.enableSoftAp != previous.enableSoftAp) WifiManager.fallbackToSoftAp(updated.enableSoftAp);
 
-      preferences.putString("otaPassword", jsonBuffer["otaPassword"].as<String>());
-      preferences.putBool("otaWebEnabled", jsonBuffer["otaWebEnabled"].as<boolean>());
-      if (preferences.putString("otaWebUrl", jsonBuffer["otaWebUrl"].as<String>())) {
-        otaWebUpdater.setBaseUrl(jsonBuffer["otaWebUrl"].as<String>());
-      }  
-
-      // MQTT Settings
-      preferences.putUInt("mqttPort", jsonBuffer["mqttPort"].as<uint16_t>());
-      preferences.putString("mqttHost", jsonBuffer["mqttHost"].as<String>());
-      preferences.putString("mqttTopic", jsonBuffer["mqttTopic"].as<String>());
-      preferences.putString("mqttUser", jsonBuffer["mqttUser"].as<String>());
-      preferences.putString("mqttPass", jsonBuffer["mqttPass"].as<String>());
-      if (preferences.putBool("enableMqtt", jsonBuffer["enableMqtt"].as<boolean>())) {
-        if (enableMqtt) Mqtt.disconnect();
-        enableMqtt = jsonBuffer["enableMqtt"].as<boolean>();
-        if (enableMqtt) {
-          Mqtt.prepare(
-            jsonBuffer["mqttHost"].as<String>(),
-            jsonBuffer["mqttPort"].as<uint16_t>(),
-            jsonBuffer["mqttTopic"].as<String>(),
-            jsonBuffer["mqttUser"].as<String>(),
-            jsonBuffer["mqttPass"].as<String>()
-          );
-          Mqtt.connect();
-        }
+    if (updated.enableBle != previous.enableBle || updated.enableBleBroadcast != previous.enableBleBroadcast) {
+      if (enableBle) stopBleServer();
+      enableBle = updated.enableBle;
+      enableBleBroadcast = updated.enableBleBroadcast;
+      if (enableBle) createBleServer(hostname, LEVELMANAGERS);
+      yield();
+    }
+    enableDac = updated.enableDac;
+
+    if (updated.otaWebUrl != previous.otaWebUrl) otaWebUpdater.setBaseUrl(updated.otaWebUrl);
+
+    bool mqttChanged = updated.mqttHost != previous.mqttHost || updated.mqttPort != previous.mqttPort
+      || updated.mqttTopic != previous.mqttTopic || updated.mqttUser != previous.mqttUser || updated.mqttPass != previous.mqttPass;
+    if (updated.enableMqtt != previous.enableMqtt || (updated.enableMqtt && mqttChanged)) {
+      if (enableMqtt) Mqtt.disconnect();
+      enableMqtt = updated.enableMqtt;
+      if (enableMqtt) {
+        Mqtt.prepare(updated.mqttHost, updated.mqttPort, updated.mqttTopic, updated.mqttUser, updated.mqttPass);
+        Mqtt.connect();
       }
     }
-    preferences.end();
 
     request->send(200, "application/json", "{\"message\":\"New configuration stored in NVS, reboot required!\"}");
   });
 
-  webServer.on("/api/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
     if (request->contentType() == "application/json") {
       String output;
       DynamicJsonDocument doc(1024);
 
-      if (preferences.begin(NVS_NAMESPACE, true)) {
-        doc["hostname"] = hostname;
-        doc["enableWifi"] = enableWifi;
-        doc["enableSoftAp"] = WifiManager.getFallbackState();
-        doc["enableBle"] = enableBle;
-        doc["enableDac"] = enableDac;
-
-        doc["otaPassword"] = preferences.getString("otaPassword");
-
-        // MQTT
-        doc["enableMqtt"] = enableMqtt;
-        doc["mqttPort"] = preferences.getUInt("mqttPort", 1883);
-        doc["mqttHost"] = preferences.getString("mqttHost", "");
-        doc["mqttTopic"] = preferences.getString("mqttTopic", "");
-        doc["mqttUser"] = preferences.getString("mqttUser", "");
-        doc["mqttPass"] = preferences.getString("mqttPass", "");
-      }
-      preferences.end();
+      const ConfigData &config = Config.get();
+      doc["hostname"] = config.hostname;
+      doc["enableWifi"] = enableWifi;
+      doc["enableSoftAp"] = WifiManager.getFallbackState();
+      doc["enableBle"] = enableBle;
+      doc["enableBleBroadcast"] = enableBleBroadcast;
+      doc["enableDac"] = enableDac;
+
+      doc["otaPassword"] = config.otaPassword;
+      doc["otaWebEnabled"] = config.otaWebEnabled;
+      doc["otaWebUrl"] = config.otaWebUrl;
+
+      // MQTT
+      doc["enableMqtt"] = enableMqtt;
+      doc["mqttPort"] = config.mqttPort;
+      doc["mqttHost"] = config.mqttHost;
+      doc["mqttTopic"] = config.mqttTopic;
+      doc["mqttUser"] = config.mqttUser;
+      doc["mqttPass"] = config.mqttPass;
 
       serializeJson(doc, output);
       request->send(200, "application/json", output);
     } else request->send(415, "text/plain", "Unsupported Media Type");
   });
 
-  webServer.on("/api/scale/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/scale/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
     uint8_t scale = request->getParam("scale")->value().toInt();
     if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
@@ -172,7 +261,7 @@ void APIRegisterRoutes() {
     } else request->send(415, "text/plain", "Unsupported Media Type");
   });
 
-  webServer.on("/api/scale/config", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  apiRoute("/api/scale/config", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
 
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
@@ -184,7 +273,109 @@ void APIRegisterRoutes() {
     else return request->send(422, "application/json", "{\"message\":\"Invalid data or unable to write to NVS\"}");
   });
 
-  webServer.on("/api/calibrate/empty", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  // Start a recording of the raw readings, replaces the last recording of this scale
+  apiRoute("/api/scale/recording", HTTP_POST,
+    [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
+
+    if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
+    uint8_t scale = request->getParam("scale")->value().toInt();
+    if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
+
+    DynamicJsonDocument jsonBuffer(128);
+    if (deserializeJson(jsonBuffer, (const char*)data, len)) return request->send(422, "application/json", "{\"message\":\"Invalid data\"}");
+    uint32_t interval = jsonBuffer["interval"] | 5000U;
+
+    size_t space = recordingSpace(scale);
+    if (space < sizeof(RecordingHeader) + RECORDING_BUFFER_SAMPLES * sizeof(RecordingSample)) {
+      return request->send(507, "application/json", "{\"message\":\"Not enough space for a recording\"}");
+    }
+    if (LevelManagers[scale-1]->startRecording(LittleFS, recordingPath(scale), interval, space)) {
+      request->send(200, "application/json", "{\"message\":\"Recording started\"}");
+    } else request->send(500, "application/json", "{\"message\":\"Unable to write the recording\"}");
+  });
+
+  // Stop the recording and delete it
+  apiRoute("/api/scale/recording", HTTP_DELETE, [&](AsyncWebServerRequest *request) {
+    if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
+    uint8_t scale = request->getParam("scale")->value().toInt();
+    if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
+
+    LevelManagers[scale-1]->stopRecording();
+    if (LittleFS.exists(recordingPath(scale)) && !LittleFS.remove(recordingPath(scale))) {
+      return request->send(500, "application/json", "{\"message\":\"Unable to delete the recording\"}");
+    }
+    request->send(200, "application/json", "{\"message\":\"Recording deleted\"}");
+  });
+
+  // Download the recording, a running recording continues
+  apiRoute("/api/scale/recording", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
+    uint8_t scale = request->getParam("scale")->value().toInt();
+    if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
+
+    LevelManagers[scale-1]->flushRecording();
+    if (!LittleFS.exists(recordingPath(scale))) return request->send(404, "application/json", "{\"message\":\"No recording of this scale\"}");
+    request->send(LittleFS, recordingPath(scale), "application/octet-stream", true);
+  });
+
+  // Replay the recording through the pipeline with its calibration, without touching the live scale.
+  // The optional interval (ms) skips samples to simulate a slower sensor interval. Streams CSV rows.
+  apiRoute("/api/scale/replay", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");
+    uint8_t scale = request->getParam("scale")->value().toInt();
+    if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
+    uint32_t interval = request->hasParam("interval") ? request->getParam("interval")->value().toInt() : 0;
+
+    struct ReplayStream {
+      File file;
+      RecordingReader reader;
+      SCALEMANAGER scale;
+      bool header = true;
+      char row[64];                             // next line of the CSV, a row has less than 64 characters
+      size_t rowLen = 0;
+    };
+    auto stream = std::make_shared<ReplayStream>();
+    LevelManagers[scale-1]->flushRecording();
+    stream->file = LittleFS.open(recordingPath(scale), FILE_READ);
+    if (!stream->file || !stream->reader.begin(stream->file, interval)) {
+      return request->send(404, "application/json", "{\"message\":\"No recording of this scale\"}");
+    }
+    stream->scale.applyRecordingConfig(stream->reader.getHeader());
+
+    request->send(request->beginChunkedResponse("text/csv", [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+      size_t len = 0;
+      for (;;) {
+        if (stream->rowLen == 0) {
+          int n;
+          RecordingSample sample;
+          if (stream->header) {
+            n = snprintf(stream->row, sizeof(stream->row), "time,temperature,pressure,count,sensorValue,level,gasWeight\n");
+            stream->header = false;
+          } else if (stream->reader.next(sample)) {
+            stream->scale.replaySample(sample);
+            char temperature[8] = "", pressure[8] = "";
+            if (sample.temperature != INT16_MIN) snprintf(temperature, sizeof(temperature), "%.2f", sample.temperature / 100.f);
+            if (sample.pressure) snprintf(pressure, sizeof(pressure), "%.1f", sample.pressure / 10.f);
+            n = snprintf(stream->row, sizeof(stream->row), "%u,%s,%s,%u,%u,%u,%u\n",
+              sample.time, temperature, pressure, sample.count,
+              stream->scale.getLastMedian(), stream->scale.getLevel(), stream->scale.getGasWeight()
+            );
+          } else break;
+          stream->rowLen = constrain(n, 0, (int)sizeof(stream->row) - 1);
+        }
+        // Rows are never split, the row is kept for the next call if it does not fit
+        if (stream->rowLen > maxLen - len) break;
+        memcpy(buffer + len, stream->row, stream->rowLen);
+        len += stream->rowLen;
+        stream->rowLen = 0;
+      }
+      // Returning 0 would end the response
+      if (len == 0 && stream->rowLen > 0) return RESPONSE_TRY_AGAIN;
+      return len;
+    }));
+  });
+
+  apiRoute("/api/calibrate/empty", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
       
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");    
@@ -196,7 +387,7 @@ void APIRegisterRoutes() {
     request->send(200, "application/json", "{\"message\":\"Empty scale calibration done!\"}");
   });
 
-  webServer.on("/api/calibrate/weight", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  apiRoute("/api/calibrate/weight", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
       
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");    
@@ -211,7 +402,7 @@ void APIRegisterRoutes() {
     request->send(200, "application/json", "{\"message\":\"Setup completed\"}");
   });
 
-  webServer.on("/api/calibrate/bottleweight", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  apiRoute("/api/calibrate/bottleweight", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
       
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");    
@@ -239,7 +430,7 @@ void APIRegisterRoutes() {
     }
   });
 
-  webServer.on("/api/calibrate/bottleweight", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/calibrate/bottleweight", HTTP_GET, [&](AsyncWebServerRequest *request) {
     if (!request->hasParam("scale")) return request->send(400, "application/json", "{\"message\":\"Missing parameter scale\"}");    
     uint8_t scale = request->getParam("scale")->value().toInt();
     if (scale > LEVELMANAGERS or scale < 1) return request->send(400, "application/json", "{\"message\":\"Bad request, value outside available scales\"}");
@@ -254,7 +445,7 @@ void APIRegisterRoutes() {
     request->send(200, "application/json", output);
   });
 
-  webServer.on("/api/level/current/all", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/level/current/all", HTTP_GET, [&](AsyncWebServerRequest *request) {
     String output;
     DynamicJsonDocument jsonDoc(1024);
 
@@ -269,7 +460,7 @@ void APIRegisterRoutes() {
     request->send(200, "application/json", output);
   });
 
-  webServer.on("/api/level/num", HTTP_GET, [&](AsyncWebServerRequest *request) {
+  apiRoute("/api/level/num", HTTP_GET, [&](AsyncWebServerRequest *request) {
     String output;
     DynamicJsonDocument json(256);
     json["num"] = LEVELMANAGERS;
@@ -277,7 +468,7 @@ void APIRegisterRoutes() {
     request->send(200, "application/json", output);
   });
 
-  webServer.on("/api/partition/switch", HTTP_POST, [&](AsyncWebServerRequest * request){}, NULL,
+  apiRoute("/api/partition/switch", HTTP_POST,
     [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
     auto next = esp_ota_get_next_update_partition(NULL);
     auto error = esp_ota_set_boot_partition(next);
@@ -288,13 +479,80 @@ void APIRegisterRoutes() {
     }
   });
 
-  webServer.on("/api/esp", HTTP_GET, [&](AsyncWebServerRequest * request) {
+  apiRoute("/api/log/config", HTTP_GET, [&](AsyncWebServerRequest *request) {
     String output;
-    DynamicJsonDocument json(2048);
+    StaticJsonDocument<128> doc;
+    doc["level"] = logLevel;
+    doc["modules"] = logModules;
+    doc["compiledLevel"] = LOG_LEVEL;
+    serializeJson(doc, output);
+    request->send(200, "application/json", output);
+  });
+
+  apiRoute("/api/log/config", HTTP_POST,
+    [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
+
+    StaticJsonDocument<128> jsonBuffer;
+    if (deserializeJson(jsonBuffer, (const char*)data, len)) return request->send(422, "application/json", "{\"message\":\"Invalid data\"}");
+    if (jsonBuffer["level"].is<uint8_t>()) {
+      if (jsonBuffer["level"].as<uint8_t>() > LOG_LEVEL_TRACE) return request->send(422, "application/json", "{\"message\":\"Invalid data: level\"}");
+      logLevel = jsonBuffer["level"].as<uint8_t>();
+    }
+    if (jsonBuffer["modules"].is<uint32_t>()) logModules = jsonBuffer["modules"].as<uint32_t>();
+    request->send(200, "application/json", "{\"message\":\"New log configuration applied\"}");
+  });
+
+  // Registered after /api/log/config, as it would match all urls below /api/log/ as well
+  apiRoute("/api/log", HTTP_GET, [&](AsyncWebServerRequest *request) {
+    request->send(LogFile.beginResponse(request));
+  });
 
-    JsonObject booting = json.createNestedObject("booting");
-    booting["rebootReason"] = esp_reset_reason();
-    booting["partitionCount"] = esp_ota_get_app_partition_count();
+  apiRoute("/api/boot", HTTP_GET, [&](AsyncWebServerRequest * request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    Boot.printJson(*response);
+    request->send(response);
+  });
+
+  apiRoute("/api/telemetry", HTTP_GET, [&](AsyncWebServerRequest * request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    Telemetry.printJson(*response);
+    request->send(response);
+  });
+
+  apiRoute("/api/energy/model", HTTP_POST,
+    [&](AsyncWebServerRequest * request, uint8_t *data, size_t len, size_t index, size_t total) {
+
+    StaticJsonDocument<512> jsonBuffer;
+    if (deserializeJson(jsonBuffer, (const char*)data, len)) return request->send(422, "application/json", "{\"message\":\"Invalid data\"}");
+    if (!Energy.updateModel(jsonBuffer.as<JsonObjectConst>())) return request->send(500, "application/json", "{\"message\":\"Unable to write to NVS\"}");
+    request->send(200, "application/json", "{\"message\":\"New current model stored in NVS\"}");
+  });
+
+  // Registered after /api/energy/model, as it would match all urls below /api/energy/ as well
+  apiRoute("/api/energy", HTTP_GET, [&](AsyncWebServerRequest * request) {
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    Energy.printJson(*response);
+    request->send(response);
+  });
+
+  apiRoute("/api/energy", HTTP_DELETE, [&](AsyncWebServerRequest * request) {
+    Energy.reset();
+    request->send(200, "application/json", "{\"message\":\"Energy accounting cleared\"}");
+  });
+
+  apiRoute("/api/metrics", HTTP_GET, [&](AsyncWebServerRequest * request) {
+    metricUptime.set(esp_timer_get_time() / 1000000.f);
+    metricFreeHeap.set(ESP.getFreeHeap());
+    metricMinFreeHeap.set(ESP.getMinFreeHeap());
+    metricLargestFreeBlock.set(ESP.getMaxAllocHeap());
+
+    AsyncResponseStream *response = request->beginResponseStream("text/plain; version=0.0.4");
+    Metric::renderAll(*response);
+    request->send(response);
+  });
+
+  apiRoute("/api/esp", HTTP_GET, [&](AsyncWebServerRequest * request) {
+    StaticJsonDocument<1024> json;
 
     auto partition = esp_ota_get_boot_partition();
     JsonObject bootPartition = json.createNestedObject("bootPartition");
@@ -309,23 +567,6 @@ void APIRegisterRoutes() {
     }
     bootPartition["subtype"] = partition->subtype;
 
-    partition = esp_ota_get_running_partition();
-    JsonObject runningPartition = json.createNestedObject("runningPartition");
-    runningPartition["address"] = partition->address;
-    runningPartition["size"] = partition->size;
-    runningPartition["label"] = partition->label;
-    runningPartition["encrypted"] = partition->encrypted;
-    switch (partition->type) {
-      case ESP_PARTITION_TYPE_APP:  runningPartition["type"] = "app"; break;
-      case ESP_PARTITION_TYPE_DATA: runningPartition["type"] = "data"; break;
-      default: runningPartition["type"] = "any";
-    }
-    runningPartition["subtype"] = partition->subtype;
-
-    JsonObject build = json.createNestedObject("build");
-    build["date"] = __DATE__;
-    build["time"] = __TIME__;
-
     JsonObject ram = json.createNestedObject("ram");
     ram["heapSize"] = ESP.getHeapSize();
     ram["freeHeap"] = ESP.getFreeHeap();
@@ -349,29 +590,30 @@ void APIRegisterRoutes() {
     chip["efuseMac"] = ESP.getEfuseMac();
     chip["temperature"] = (temprature_sens_read() - 32) / 1.8;
 
-    JsonObject flash = json.createNestedObject("flash");
-    flash["flashChipSize"] = ESP.getFlashChipSize();
-    flash["flashChipRealSize"] = spi_flash_get_chip_size();
-    flash["flashChipSpeedMHz"] = ESP.getFlashChipSpeed() / 1000000;
-    flash["flashChipMode"] = ESP.getFlashChipMode();
-    flash["sdkVersion"] = ESP.getFlashChipSize();
-
-    JsonObject sketch = json.createNestedObject("sketch");
-    sketch["size"] = ESP.getSketchSize();
-    sketch["maxSize"] = ESP.getFreeSketchSpace();
-    sketch["usagePercent"] = (float)ESP.getSketchSize() / (float)ESP.getFreeSketchSpace() * 100.f;
-    sketch["md5"] = ESP.getSketchMD5();
-
     JsonObject fs = json.createNestedObject("filesystem");
     fs["type"] = F("LittleFS");
     fs["totalBytes"] = LittleFS.totalBytes();
     fs["usedBytes"] = LittleFS.usedBytes();
     fs["usagePercent"] = (float)LittleFS.usedBytes() / (float)LittleFS.totalBytes() * 100.f;
-    
-    serializeJson(json, output);
-    request->send(200, "application/json", output);
+
+    // Splice the live values behind the cached static part
+    AsyncResponseStream *response = request->beginResponseStream("application/json");
+    response->print("{");
+    response->print(espStaticInfo());
+    for (JsonPair kv : json.as<JsonObject>()) {
+      response->printf(",\"%s\":", kv.key().c_str());
+      serializeJson(kv.value(), *response);
+    }
+    response->print("}");
+    request->send(response);
   });
 
+  // Precompressed UI with content hash ETags, see tools/webui_assets.py
+  webUi.begin(LittleFS);
+  webServer.addHandler(&webUi);
+
+#ifndef WEBUI_EMBEDDED
+  // Fallback for littlefs.bin images built without an asset manifest
   File tmp = LittleFS.open("/index.html");
   time_t cr = tmp.getLastWrite();
   tmp.close();
@@ -381,11 +623,13 @@ void APIRegisterRoutes() {
     .setCacheControl("max-age=86400")
     .setLastModified(timeinfo)
     .setDefaultFile("index.html");
-
+#endif
 
   webServer.onNotFound([&](AsyncWebServerRequest *request) {
     if (request->method() == HTTP_OPTIONS) {
       request->send(200);
+    } else if (webUi.isReady()) {
+      webUi.sendIndex(request);
     } else {
       AsyncWebServerResponse *response = request->beginResponse(LittleFS, "/index.html");
       response->setCode(200);
@@ -10,41 +10,225 @@
  * License: CC BY-NC-SA 4.0
  */
 
+#define LOG_MODULE LOG_MOD_BLE
 #include "log.h"
 
 #include "ble.h"
+#include "history.h"
+#include "energy.h"
 #include <NimBLEDevice.h>
 
 static NimBLEServer* pServer;
 
+// Cached, the lookup by UUID is not required on every update
+static NimBLECharacteristic* levelCharacteristics[BLE_MAX_SCALES];
+static int16_t levelValues[BLE_MAX_SCALES];  // -1 if not set yet
+static uint8_t levelCount = 0;
+
+// Values of the advertising broadcast
+static uint16_t gasWeights[BLE_MAX_SCALES];
+static uint8_t broadcastSequence = 0;
+static bool broadcastChanged = false;
+
+// History transfer, requests are written by the NimBLE host, the packets are sent by bleHistoryTask.
+// Each notification consumes one credit, the client grants more to control the flow.
+static NimBLECharacteristic* historyCharacteristic = nullptr;
+static TaskHandle_t historyTask = NULL;
+static portMUX_TYPE historyMux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t historyRequest = 0;         // incremented on every new request
+static uint32_t historyCursor = 0;          // index of the next record to send
+static uint32_t historyEnd = 0;             // index after the last requested record
+static uint16_t historyCredits = 0;
+static uint16_t historyMtu = BLE_ATT_MTU_DFLT;
+static bool historyActive = false;
+static bool historySending = false;         // the task uses historyCharacteristic outside of the lock
+
 bool enableBle = true;                      // Enable Ble, disable to reduce power consumtion, stored in NVS
+bool enableBleBroadcast = true;             // Broadcast all levels within the advertising data, stored in NVS
+
+static uint32_t readU32(const uint8_t * p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void writeU32(uint8_t * p, uint32_t value) {
+  p[0] = value;
+  p[1] = value >> 8;
+  p[2] = value >> 16;
+  p[3] = value >> 24;
+}
+
+class ServerCallbacks : public NimBLEServerCallbacks {
+  void onDisconnect(NimBLEServer* pServer) {
+    portENTER_CRITICAL(&historyMux);
+    historyActive = false;
+    portEXIT_CRITICAL(&historyMux);
+  }
+};
+
+class HistoryCallbacks : public NimBLECharacteristicCallbacks {
+  void onRead(NimBLECharacteristic* pCharacteristic) {
+    // Available range and the current time, so clients can request only missing records
+    uint8_t info[13];
+    writeU32(info, History.getFirstIndex());
+    writeU32(info + 4, History.getNextIndex());
+    writeU32(info + 8, time(NULL));
+    info[12] = sizeof(HistoryRecord);
+    pCharacteristic->setValue(info, sizeof(info));
+  }
+
+  void onWrite(NimBLECharacteristic* pCharacteristic, ble_gap_conn_desc* desc) {
+    std::string value = pCharacteristic->getValue();
+    const uint8_t * data = (const uint8_t *)value.data();
+    uint16_t mtu = pServer->getPeerMTU(desc->conn_handle);
+
+    portENTER_CRITICAL(&historyMux);
+    if (value.length() == BLE_HISTORY_REQUEST_SIZE) {
+      uint32_t count = readU32(data + 4);
+      historyCursor = readU32(data);
+      historyEnd = (count == 0 || count > UINT32_MAX - historyCursor) ? UINT32_MAX : historyCursor + count;
+      historyCredits = data[8] | (data[9] << 8);
+      historyRequest++;
+      historyActive = true;
+    } else if (value.length() == 2) {
+      historyCredits = min(historyCredits + (data[0] | (data[1] << 8)), (int)UINT16_MAX);
+    }
+    if (mtu) historyMtu = min(mtu, (uint16_t)BLE_HISTORY_MTU);
+    portEXIT_CRITICAL(&historyMux);
+
+    if (historyTask != NULL) xTaskNotifyGive(historyTask);
+  }
+};
+
+/**
+ * @brief Background Task sending the requested history records as notifications
+ */
+void bleHistoryTask(void* param) {
+  HistoryRecord records[(BLE_HISTORY_MTU - 3 - 4) / sizeof(HistoryRecord)];
+  uint8_t packet[BLE_HISTORY_MTU - 3];
+
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for(;;) {
+      // The characteristic is only valid while historySending is set, see stopBleServer()
+      portENTER_CRITICAL(&historyMux);
+      NimBLECharacteristic* characteristic = historyCharacteristic;
+      bool send = historyActive && historyCredits && characteristic != nullptr;
+      historySending = send;
+      uint32_t request = historyRequest;
+      uint32_t cursor = historyCursor;
+      uint32_t end = historyEnd;
+      uint16_t mtu = historyMtu;
+      portEXIT_CRITICAL(&historyMux);
+      if (!send) break;
+
+      // Each packet starts with the index of the first record, a packet without records ends the transfer
+      size_t count = min((size_t)(mtu - 3 - 4) / sizeof(HistoryRecord), sizeof(records) / sizeof(HistoryRecord));
+      count = cursor < end ? min(count, (size_t)(end - cursor)) : 0;
+      size_t n = History.read(cursor, records, count);
+      writeU32(packet, cursor);
+      memcpy(packet + 4, records, n * sizeof(HistoryRecord));
+      {
+        EnergyScope energy(ENERGY_BLE);
+        characteristic->setValue(packet, 4 + n * sizeof(HistoryRecord));
+        characteristic->notify();
+      }
+
+      portENTER_CRITICAL(&historyMux);
+      historySending = false;
+      if (request == historyRequest) {
+        historyCursor = cursor + n;
+        historyCredits--;
+        if (n == 0) historyActive = false;
+      }
+      portEXIT_CRITICAL(&historyMux);
+    }
+  }
+}
 
 void stopBleServer() {
-  NimBLEDevice::deinit();
+  // Stop the transfer and wait until the task has sent its last packet, the characteristic
+  // is deleted with the stack
+  bool sending;
+  portENTER_CRITICAL(&historyMux);
+  historyActive = false;
+  historyCharacteristic = nullptr;
+  sending = historySending;
+  portEXIT_CRITICAL(&historyMux);
+  while (sending) {
+    vTaskDelay(1);
+    portENTER_CRITICAL(&historyMux);
+    sending = historySending;
+    portEXIT_CRITICAL(&historyMux);
+  }
+  levelCount = 0;
+  // Delete the server and the advertising as well, custom advertising data would otherwise
+  // survive a restart of the stack with the broadcast disabled
+  NimBLEDevice::deinit(true);
+  pServer = nullptr;
 }
 
-void createBleServer(String hostname) {
+void createBleServer(String hostname, uint8_t scales) {
   LOG_INFO_LN(F("[BLE] Initializing the Bluetooth low energy (BLE) stack"));
   NimBLEDevice::init(hostname.c_str());
   //NimBLEDevice::setPower(ESP_PWR_LVL_P9, ESP_BLE_PWR_TYPE_ADV);
   //NimBLEDevice::setSecurityIOCap(BLE_HS_IO_NO_INPUT_OUTPUT);
   //NimBLEDevice::setOwnAddrType(BLE_OWN_ADDR_PUBLIC);
+  NimBLEDevice::setMTU(BLE_HISTORY_MTU);
   pServer = NimBLEDevice::createServer();
+  pServer->setCallbacks(new ServerCallbacks());
 
   // BLE Environmental Service (haven't found a better one)
   NimBLEService *pEnvService = pServer->createService(BLE_SERVICE_LEVEL);
-  NimBLECharacteristic *pCharacteristicLevel = pEnvService->createCharacteristic(BLE_CHARACTERISTIC_LEVEL, // Generic Level
+
+  // One characteristic per scale with the same UUID, the first one stays compatible to
+  // clients that only know a single scale. Clients can tell them apart by the description.
+  levelCount = min(scales, (uint8_t)BLE_MAX_SCALES);
+  for (uint8_t i = 0; i < levelCount; i++) {
+    NimBLECharacteristic *pCharacteristicLevel = pEnvService->createCharacteristic(BLE_CHARACTERISTIC_LEVEL, // Generic Level
+      NIMBLE_PROPERTY::READ |
+      NIMBLE_PROPERTY::BROADCAST |
+      NIMBLE_PROPERTY::NOTIFY 
+      //NIMBLE_PROPERTY::INDICATE
+    );
+    NimBLE2904* p2904 = (NimBLE2904*)pCharacteristicLevel->createDescriptor("2904"); 
+    p2904->setFormat(NimBLE2904::FORMAT_UINT8);
+    p2904->setUnit(0x27AD);                 // percentage
+    p2904->setNamespace(1);                 // Bluetooth SIG namespace
+    p2904->setDescription(i + 1);           // "first", "second", ...
+    NimBLEDescriptor* p2901 = pCharacteristicLevel->createDescriptor("2901", NIMBLE_PROPERTY::READ, 20);
+    p2901->setValue("Scale " + std::to_string(i + 1));
+
+    pCharacteristicLevel->setValue((uint8_t)0);
+    levelCharacteristics[i] = pCharacteristicLevel;
+    levelValues[i] = -1;
+    gasWeights[i] = 0;
+  }
+
+  NimBLECharacteristic *pCharacteristicHistory = pEnvService->createCharacteristic(BLE_CHARACTERISTIC_HISTORY,
     NIMBLE_PROPERTY::READ |
-    NIMBLE_PROPERTY::BROADCAST |
-    NIMBLE_PROPERTY::NOTIFY 
-    //NIMBLE_PROPERTY::INDICATE
+    NIMBLE_PROPERTY::WRITE |
+    NIMBLE_PROPERTY::NOTIFY
   );
-  NimBLE2904* p2904 = (NimBLE2904*)pCharacteristicLevel->createDescriptor("2904"); 
-  p2904->setFormat(NimBLE2904::FORMAT_UINT8);
-  p2904->setUnit(NimBLE2904::FORMAT_UINT8);
+  NimBLEDescriptor* p2901 = pCharacteristicHistory->createDescriptor("2901", NIMBLE_PROPERTY::READ, 20);
+  p2901->setValue("History");
+  pCharacteristicHistory->setCallbacks(new HistoryCallbacks());
+
+  if (historyTask == NULL) {
+    BaseType_t xReturned = xTaskCreate(
+      bleHistoryTask,
+      "BleHistory",
+      3072,   // Stack size in words
+      NULL,   // Task input parameter
+      1,      // Priority of the task
+      &historyTask  // Task handle.
+    );
+    if (xReturned != pdPASS) LOG_ERROR_LN(F("[BLE] Unable to run the history transfer Task"));
+  }
+  portENTER_CRITICAL(&historyMux);
+  historyCharacteristic = pCharacteristicHistory;
+  portEXIT_CRITICAL(&historyMux);
 
   pEnvService->start();
-  pCharacteristicLevel->setValue(0);
   
   NimBLEAdvertising* pAdvertising = NimBLEDevice::getAdvertising();
   LOG_INFO(F("[BLE] Begin Advertising of "));
@@ -52,21 +236,59 @@ void createBleServer(String hostname) {
   pAdvertising->addServiceUUID(pEnvService->getUUID());
   //pAdvertising->setScanResponse(true); // false will reduce power consumtion
   //pAdvertising->setAdvertisementType(BLE_GAP_CONN_MODE_DIR);
+  if (enableBleBroadcast) {
+    // Custom advertising data disables the generated scan response, the name is still required
+    NimBLEAdvertisementData scanResponse;
+    scanResponse.setName(hostname.c_str());
+    pAdvertising->setScanResponseData(scanResponse);
+    broadcastChanged = true;
+    updateBleAdvertisement();
+  }
   NimBLEDevice::startAdvertising();
   LOG_INFO_LN(F("[BLE] Advertising Started"));
 }
 
-void updateBleCharacteristic(int val) {
-  if (pServer->getConnectedCount()) {
-    NimBLEService* pSvc = pServer->getServiceByUUID(BLE_SERVICE_LEVEL);
-    if(pSvc) {
-        NimBLECharacteristic* pChr = pSvc->getCharacteristic(BLE_CHARACTERISTIC_LEVEL);
-        if(pChr) {
-            LOG_INFO(F("[BLE] set value (and notify) to "));
-            LOG_INFO_LN(val);
-            pChr->setValue(val);
-            pChr->notify(true);
-        }
-    }
+void updateBleCharacteristic(uint8_t scale, uint8_t level, uint32_t gasWeight) {
+  if (scale >= levelCount) return;
+
+  uint16_t weight = min(gasWeight, (uint32_t)UINT16_MAX);
+  if (gasWeights[scale] != weight) {
+    gasWeights[scale] = weight;
+    broadcastChanged = true;
+  }
+  if (levelValues[scale] == level) return;
+  levelValues[scale] = level;
+  broadcastChanged = true;
+
+  // always update the value, a client may read it after connecting
+  LOG_DEBUG_F("[BLE] set value of scale %d to %d\n", scale + 1, level);
+  EnergyScope energy(ENERGY_BLE);
+  levelCharacteristics[scale]->setValue(level);
+  if (pServer->getConnectedCount()) levelCharacteristics[scale]->notify();
+}
+
+void updateBleAdvertisement() {
+  if (!enableBleBroadcast || !broadcastChanged || !levelCount) return;
+  broadcastChanged = false;
+
+  std::string payload;
+  payload += (char)(BLE_BROADCAST_COMPANY & 0xFF);
+  payload += (char)(BLE_BROADCAST_COMPANY >> 8);
+  payload += (char)BLE_BROADCAST_VERSION;
+  payload += (char)broadcastSequence++;
+  for (uint8_t i = 0; i < levelCount; i++) {
+    payload += (char)(levelValues[i] < 0 ? 0 : levelValues[i]);
+    payload += (char)(gasWeights[i] & 0xFF);
+    payload += (char)(gasWeights[i] >> 8);
   }
+
+  // Replaces the generated advertising data, the name is sent within the scan response.
+  // 3 bytes flags + 4 bytes service UUID + 2 bytes AD header, 4 bytes header and 12 bytes for
+  // 4 scales of the manufacturer data = 25 of 31 bytes.
+  NimBLEAdvertisementData data;
+  data.setFlags(BLE_HS_ADV_F_DISC_GEN | BLE_HS_ADV_F_BREDR_UNSUP);
+  data.setCompleteServices(NimBLEUUID(BLE_SERVICE_LEVEL));
+  data.setManufacturerData(payload);
+  NimBLEDevice::getAdvertising()->setAdvertisementData(data);
+  LOG_DEBUG_F("[BLE] Advertising data updated (sequence %d)\n", (uint8_t)(broadcastSequence - 1));
 }
@@ -12,11 +12,29 @@
 
 #define BLE_SERVICE_LEVEL "2AF9"            // Bluetooth LE service ID for tank level
 #define BLE_CHARACTERISTIC_LEVEL "181A"     // Bluetooth LE characteristic ID for tank level value
+#define BLE_MAX_SCALES 4                    // One level characteristic is created for each scale
+
+// Bulk transfer of the stored history, see README.md for the protocol
+#define BLE_CHARACTERISTIC_HISTORY "8f1c0001-5b9a-4d1e-9c43-6a7d0b2e4f10"
+#define BLE_HISTORY_MTU 247                 // Preferred MTU, fits into a single LE data length extended packet
+#define BLE_HISTORY_REQUEST_SIZE 10         // first index (u32), number of records (u32, 0 = all), credits (u16)
+
+// Manufacturer specific advertising data, readable without a connection
+#define BLE_BROADCAST_COMPANY 0xFFFF        // Bluetooth SIG reserved ID for tests and internal use
+#define BLE_BROADCAST_VERSION 1             // Increment on incompatible changes of the layout below
+// Layout: company (u16), version (u8), sequence (u8), per scale: level (u8, %), gas weight (u16, gramms)
+// All values are little endian, the sequence is incremented on every change of a value
 
 #include <Arduino.h>
 
 extern bool enableBle;
+extern bool enableBleBroadcast;
 
 void stopBleServer();
-void createBleServer(String hostname);
-void updateBleCharacteristic(int val);
+void createBleServer(String hostname, uint8_t scales = 1);
+
+// Set the level of a scale, clients are only notified if the value changed
+void updateBleCharacteristic(uint8_t scale, uint8_t level, uint32_t gasWeight = 0);
+
+// Publish changed values in the advertising data, call once after all scales are updated
+void updateBleAdvertisement();
@@ -0,0 +1,57 @@
+/**
+ * @file boot.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Timing of the boot stages
+ * @version 0.1
+ * @date 2023-02-17
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "boot.h"
+#include <esp_sleep.h>
+
+BootClass Boot;
+
+uint8_t BootClass::begin(const char * name) {
+  uint32_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&mux);
+  uint8_t stage = count;
+  if (count < BOOT_MAX_STAGES) {
+    stages[stage] = { name, now, 0, (int8_t)xPortGetCoreID() };
+    count++;
+  }
+  portEXIT_CRITICAL(&mux);
+  return stage;
+}
+
+void BootClass::end(uint8_t stage) {
+  uint32_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&mux);
+  if (stage < count) stages[stage].duration = max(now - stages[stage].start, (uint32_t)1);
+  portEXIT_CRITICAL(&mux);
+}
+
+void BootClass::finish() {
+  finished = esp_timer_get_time();
+}
+
+void BootClass::printJson(Print &out) {
+  BootStageTiming snapshot[BOOT_MAX_STAGES];
+  portENTER_CRITICAL(&mux);
+  uint8_t n = count;
+  memcpy(snapshot, stages, n * sizeof(BootStageTiming));
+  portEXIT_CRITICAL(&mux);
+
+  out.printf("{\"wakeup\":%d,\"setup\":%u,\"stages\":[", esp_sleep_get_wakeup_cause(), finished);
+  for (uint8_t i = 0; i < n; i++) {
+    out.printf("%s{\"name\":\"%s\",\"start\":%u,\"duration\":", i ? "," : "", snapshot[i].name, snapshot[i].start);
+    if (snapshot[i].duration) out.printf("%u", snapshot[i].duration);
+    else out.print("null");
+    out.printf(",\"core\":%d}", snapshot[i].core);
+  }
+  out.print("]}");
+}
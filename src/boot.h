@@ -0,0 +1,62 @@
+/**
+ * @file boot.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Timing of the boot stages
+ * @version 0.1
+ * @date 2023-02-17
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef BOOT_h
+#define BOOT_h
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#define BOOT_MAX_STAGES 16
+
+struct BootStageTiming {
+  const char * name;
+  uint32_t start;                               // us since boot
+  uint32_t duration;                            // us, 0 while running
+  int8_t core;
+};
+
+class BootClass {
+  public:
+    // Returns the stage to pass to end()
+    uint8_t begin(const char * name);
+    void end(uint8_t stage);
+
+    // setup() completed
+    void finish();
+
+    // Write all stages as JSON
+    void printJson(Print &out);
+
+  private:
+    BootStageTiming stages[BOOT_MAX_STAGES];
+    uint8_t count = 0;
+    uint32_t finished = 0;
+
+    // Stages can run in parallel, only held while updating
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+extern BootClass Boot;
+
+// Measure the lifetime of the object as a boot stage
+class BootStage {
+  public:
+    BootStage(const char * name) : stage(Boot.begin(name)) {}
+    ~BootStage() { Boot.end(stage); }
+
+  private:
+    uint8_t stage;
+};
+
+#endif // BOOT_h
@@ -0,0 +1,113 @@
+/**
+ * @file config.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Typed configuration, loaded once from NVS and kept in RAM
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "config.h"
+
+ConfigClass Config;
+
+// Visit every setting of two configurations with its NVS key, used for loading, comparing and writing
+template <typename A, typename B, typename F>
+static void forEachSetting(A &a, B &b, F visit) {
+  visit("hostname", a.hostname, b.hostname);
+  visit("enableWifi", a.enableWifi, b.enableWifi);
+  visit("enableSoftAp", a.enableSoftAp, b.enableSoftAp);
+  visit("enableBle", a.enableBle, b.enableBle);
+  visit("bleBroadcast", a.enableBleBroadcast, b.enableBleBroadcast);
+  visit("enableDac", a.enableDac, b.enableDac);
+  visit("otaPassword", a.otaPassword, b.otaPassword);
+  visit("otaWebEnabled", a.otaWebEnabled, b.otaWebEnabled);
+  visit("otaWebUrl", a.otaWebUrl, b.otaWebUrl);
+  visit("enableMqtt", a.enableMqtt, b.enableMqtt);
+  visit("mqttHost", a.mqttHost, b.mqttHost);
+  visit("mqttPort", a.mqttPort, b.mqttPort);
+  visit("mqttTopic", a.mqttTopic, b.mqttTopic);
+  visit("mqttUser", a.mqttUser, b.mqttUser);
+  visit("mqttPass", a.mqttPass, b.mqttPass);
+}
+
+// The current value is used as default for missing keys
+static void readSetting(Preferences &p, const char * key, String &value) { value = p.getString(key, value); }
+static void readSetting(Preferences &p, const char * key, bool &value) { value = p.getBool(key, value); }
+static void readSetting(Preferences &p, const char * key, uint16_t &value) { value = p.getUInt(key, value); }
+
+static bool writeSetting(Preferences &p, const char * key, const String &value) { return p.putString(key, value) == value.length(); }
+static bool writeSetting(Preferences &p, const char * key, bool value) { return p.putBool(key, value) > 0; }
+static bool writeSetting(Preferences &p, const char * key, uint16_t value) { return p.putUInt(key, value) > 0; }
+
+void ConfigClass::load() {
+  ConfigData loaded;
+  // Fails on the first boot, as the namespace does not exist yet
+  if (preferences.begin(CONFIG_NVS_NAMESPACE, true)) {
+    forEachSetting(loaded, loaded, [&](const char * key, auto &value, auto &) {
+      readSetting(preferences, key, value);
+    });
+    preferences.end();
+  }
+
+  // Invalid values are replaced one by one, everything else is kept
+  String error;
+  ConfigData defaults;
+  if (loaded.hostname.length() < 3 || loaded.hostname.length() > 32) loaded.hostname = defaults.hostname;
+  if (loaded.otaPassword.length() > 32) loaded.otaPassword = defaults.otaPassword;
+  if (loaded.mqttPort == 0) loaded.mqttPort = defaults.mqttPort;
+  if (!validate(loaded, error)) loaded.enableMqtt = false;
+  data = loaded;
+}
+
+bool ConfigClass::validate(const ConfigData &config, String &error) {
+  if (config.hostname.length() < 3 || config.hostname.length() > 32) {
+    // TODO: Add better checks according to RFC hostnames
+    error = "Invalid hostname!";
+    return false;
+  }
+  if (config.otaPassword.length() > 32) {
+    error = "Invalid OTA password!";
+    return false;
+  }
+  if (config.enableMqtt && (config.mqttHost.isEmpty() || config.mqttPort == 0)) {
+    error = "Invalid MQTT host or port!";
+    return false;
+  }
+  return true;
+}
+
+bool ConfigClass::commit(const ConfigData &updated, String &error) {
+  if (!validate(updated, error)) return false;
+  if (!preferences.begin(CONFIG_NVS_NAMESPACE)) {
+    error = "Unable to open NVS";
+    return false;
+  }
+
+  // Only changed values are written, on failure the written ones are restored
+  const char * written[16];
+  uint8_t writtenCount = 0;
+  bool success = true;
+  forEachSetting(data, updated, [&](const char * key, const auto &current, const auto &value) {
+    if (!success || current == value) return;
+    if (writeSetting(preferences, key, value)) written[writtenCount++] = key;
+    else success = false;
+  });
+
+  if (!success) {
+    forEachSetting(data, data, [&](const char * key, const auto &current, const auto &) {
+      for (uint8_t i = 0; i < writtenCount; i++) {
+        if (strcmp(written[i], key) == 0) writeSetting(preferences, key, current);
+      }
+    });
+    error = "Unable to write to NVS";
+  }
+  preferences.end();
+
+  if (success) data = updated;
+  return success;
+}
@@ -0,0 +1,64 @@
+/**
+ * @file config.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Typed configuration, loaded once from NVS and kept in RAM
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef CONFIG_h
+#define CONFIG_h
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+#define CONFIG_NVS_NAMESPACE "gaslevel"         // Same as NVS_NAMESPACE, existing settings are kept
+
+struct ConfigData {
+  String hostname = "gaslevel";
+  bool enableWifi = true;
+  bool enableSoftAp = true;
+  bool enableBle = false;
+  bool enableBleBroadcast = true;
+  bool enableDac = false;
+
+  String otaPassword;                           // generated on first boot
+  bool otaWebEnabled = true;
+  String otaWebUrl;
+
+  bool enableMqtt = false;
+  String mqttHost = "localhost";
+  uint16_t mqttPort = 1883;
+  String mqttTopic = "verges/gaslevel";
+  String mqttUser;
+  String mqttPass;
+};
+
+class ConfigClass {
+  public:
+    // Read all settings, missing or invalid values are replaced by the defaults
+    void load();
+
+    // The current configuration, served from RAM
+    const ConfigData &get() const { return data; }
+
+    // Validate and write all changed values. If a value can't be written, the already
+    // written ones are restored and the configuration in RAM stays unchanged.
+    bool commit(const ConfigData &updated, String &error);
+
+    // Returns false and a message for the first invalid value
+    static bool validate(const ConfigData &config, String &error);
+
+  private:
+    ConfigData data;
+    Preferences preferences;
+};
+
+extern ConfigClass Config;
+
+#endif // CONFIG_h
@@ -0,0 +1,154 @@
+/**
+ * @file energy.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Active time and estimated energy consumption per subsystem and radio state
+ * @version 0.1
+ * @date 2023-02-16
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "energy.h"
+#include <Preferences.h>
+#include "rtcclock.h"
+
+EnergyClass Energy;
+
+static const char * SUBSYSTEM_NAMES[ENERGY_SUBSYSTEMS] = { "hx711", "bmp", "mqtt", "ble", "web" };
+static const char * RADIO_NAMES[ENERGY_RADIO_STATES] = { "off", "wifi", "ble", "wifiBle" };
+
+// Rough values of the board with the esp32 at 240MHz, measure your own and update them using the API
+static const EnergyModel DEFAULT_MODEL = {
+  { 1.5f, 1.0f, 80.f, 15.f, 60.f },             // HX711, BMP, MQTT, BLE, Web
+  { 25.f, 50.f, 35.f, 65.f },                   // no radio, WiFi, BLE, WiFi and BLE
+  12.2f                                         // deep sleep including the step down converter
+};
+
+// Kept in RTC memory to continue the accounting after deep sleep.
+RTC_DATA_ATTR static struct energy_accounting_t {
+  uint64_t activeUs[ENERGY_SUBSYSTEMS];
+  uint32_t calls[ENERGY_SUBSYSTEMS];
+  uint64_t radioUs[ENERGY_RADIO_STATES];
+  uint64_t deepSleepUs;
+  uint32_t deepSleeps;
+  uint64_t since;                               // RTC time of the last reset
+  uint64_t lastUpdate;                          // RTC time of the last radio accounting
+  uint64_t sleepStart;                          // RTC time when entering deep sleep, 0 while awake
+} acc;
+
+void EnergyClass::begin() {
+  uint64_t now = rtcMicros();
+  uint64_t wakeup = now - esp_timer_get_time();
+
+  portENTER_CRITICAL(&mux);
+  if (acc.sleepStart && wakeup > acc.sleepStart) {
+    acc.deepSleepUs += wakeup - acc.sleepStart;
+    acc.deepSleeps++;
+  }
+  acc.sleepStart = 0;
+  if (acc.since == 0) acc.since = wakeup;
+  acc.lastUpdate = wakeup;
+  portEXIT_CRITICAL(&mux);
+
+  model = DEFAULT_MODEL;
+  Preferences preferences;
+  if (preferences.begin(ENERGY_NVS_NAMESPACE, true)) {
+    if (preferences.getBytesLength("model") == sizeof(model)) preferences.getBytes("model", &model, sizeof(model));
+    preferences.end();
+  }
+}
+
+void EnergyClass::add(EnergySubsystem subsystem, uint32_t us) {
+  if (subsystem >= ENERGY_SUBSYSTEMS) return;
+  portENTER_CRITICAL(&mux);
+  acc.activeUs[subsystem] += us;
+  acc.calls[subsystem]++;
+  portEXIT_CRITICAL(&mux);
+}
+
+void EnergyClass::accountRadio() {
+  uint64_t now = rtcMicros();
+  portENTER_CRITICAL(&mux);
+  if (now > acc.lastUpdate) acc.radioUs[radioState] += now - acc.lastUpdate;
+  acc.lastUpdate = now;
+  portEXIT_CRITICAL(&mux);
+}
+
+void EnergyClass::setRadioState(bool wifi, bool ble) {
+  accountRadio();
+  radioState = (EnergyRadioState)((wifi ? ENERGY_RADIO_WIFI : 0) | (ble ? ENERGY_RADIO_BLE : 0));
+}
+
+void EnergyClass::enterDeepSleep() {
+  accountRadio();
+  uint64_t now = rtcMicros();
+  portENTER_CRITICAL(&mux);
+  acc.sleepStart = now;
+  portEXIT_CRITICAL(&mux);
+}
+
+void EnergyClass::reset() {
+  uint64_t now = rtcMicros();
+  portENTER_CRITICAL(&mux);
+  memset(&acc, 0, sizeof(acc));
+  acc.since = now;
+  acc.lastUpdate = now;
+  portEXIT_CRITICAL(&mux);
+}
+
+bool EnergyClass::updateModel(JsonObjectConst json) {
+  EnergyModel updated = model;
+  for (uint8_t i = 0; i < ENERGY_SUBSYSTEMS; i++) {
+    JsonVariantConst value = json["subsystem"][SUBSYSTEM_NAMES[i]];
+    if (!value.isNull()) updated.subsystem[i] = value.as<float>();
+  }
+  for (uint8_t i = 0; i < ENERGY_RADIO_STATES; i++) {
+    JsonVariantConst value = json["radio"][RADIO_NAMES[i]];
+    if (!value.isNull()) updated.radio[i] = value.as<float>();
+  }
+  if (!json["deepSleep"].isNull()) updated.deepSleep = json["deepSleep"].as<float>();
+
+  Preferences preferences;
+  if (!preferences.begin(ENERGY_NVS_NAMESPACE)) return false;
+  bool stored = preferences.putBytes("model", &updated, sizeof(updated)) == sizeof(updated);
+  preferences.end();
+  if (stored) model = updated;
+  return stored;
+}
+
+void EnergyClass::printJson(Print &out) {
+  accountRadio();
+  energy_accounting_t snapshot;
+  portENTER_CRITICAL(&mux);
+  snapshot = acc;
+  portEXIT_CRITICAL(&mux);
+
+  // mA * s, converted to mAh at the end
+  double total = snapshot.deepSleepUs / 1e6 * model.deepSleep;
+  double duration = (snapshot.lastUpdate - snapshot.since) / 1e6;
+
+  out.printf("{\"since\":%.0f,\"subsystems\":{", duration);
+  for (uint8_t i = 0; i < ENERGY_SUBSYSTEMS; i++) {
+    double seconds = snapshot.activeUs[i] / 1e6;
+    total += seconds * model.subsystem[i];
+    out.printf("%s\"%s\":{\"time\":%.3f,\"calls\":%u,\"current\":%.2f,\"mAh\":%.4f}",
+      i ? "," : "", SUBSYSTEM_NAMES[i], seconds, snapshot.calls[i], model.subsystem[i], seconds * model.subsystem[i] / 3600
+    );
+  }
+  out.print("},\"radio\":{");
+  for (uint8_t i = 0; i < ENERGY_RADIO_STATES; i++) {
+    double seconds = snapshot.radioUs[i] / 1e6;
+    total += seconds * model.radio[i];
+    out.printf("%s\"%s\":{\"time\":%.3f,\"current\":%.2f,\"mAh\":%.4f}",
+      i ? "," : "", RADIO_NAMES[i], seconds, model.radio[i], seconds * model.radio[i] / 3600
+    );
+  }
+  double sleeping = snapshot.deepSleepUs / 1e6;
+  out.printf("},\"deepSleep\":{\"time\":%.3f,\"count\":%u,\"current\":%.2f,\"mAh\":%.4f},",
+    sleeping, snapshot.deepSleeps, model.deepSleep, sleeping * model.deepSleep / 3600
+  );
+  out.printf("\"total\":{\"mAh\":%.4f,\"averageCurrent\":%.2f}}", total / 3600, duration > 0 ? total / duration : 0.);
+}
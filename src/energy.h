@@ -0,0 +1,94 @@
+/**
+ * @file energy.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Active time and estimated energy consumption per subsystem and radio state
+ * @version 0.1
+ * @date 2023-02-16
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef ENERGY_h
+#define ENERGY_h
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+
+#define ENERGY_NVS_NAMESPACE "energy"           // Preferences.h namespace of the current model
+
+enum EnergySubsystem : uint8_t {
+  ENERGY_HX711 = 0,
+  ENERGY_BMP,
+  ENERGY_MQTT,
+  ENERGY_BLE,
+  ENERGY_WEB,
+  ENERGY_SUBSYSTEMS
+};
+
+// Awake time is accounted to one of these, deep sleep separately
+enum EnergyRadioState : uint8_t {
+  ENERGY_RADIO_OFF = 0,
+  ENERGY_RADIO_WIFI,
+  ENERGY_RADIO_BLE,
+  ENERGY_RADIO_WIFI_BLE,
+  ENERGY_RADIO_STATES
+};
+
+// Average current in mA, used to estimate the consumption
+struct EnergyModel {
+  float subsystem[ENERGY_SUBSYSTEMS];           // additional current while the subsystem is active
+  float radio[ENERGY_RADIO_STATES];             // current of the awake board in this radio state
+  float deepSleep;                              // current of the board in deep sleep
+};
+
+class EnergyClass {
+  public:
+    // Account the deep sleep since the last boot and load the current model from NVS
+    void begin();
+
+    // Accumulate the time of an active subsystem, see EnergyScope
+    void add(EnergySubsystem subsystem, uint32_t us);
+
+    // Account the time since the last call to the previous radio state
+    void setRadioState(bool wifi, bool ble);
+
+    // Call right before esp_deep_sleep_start()
+    void enterDeepSleep();
+
+    // Change the given values of the current model and store it in NVS
+    bool updateModel(JsonObjectConst json);
+
+    // Clear all accumulated values
+    void reset();
+
+    // Write the accounting and the estimated consumption as JSON
+    void printJson(Print &out);
+
+  private:
+    EnergyModel model;
+    EnergyRadioState radioState = ENERGY_RADIO_OFF;
+
+    // Protects the accounting in RTC memory, only held while updating
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    void accountRadio();
+};
+
+extern EnergyClass Energy;
+
+// Account the lifetime of the object to a subsystem
+class EnergyScope {
+  public:
+    EnergyScope(EnergySubsystem s) : subsystem(s), start(esp_timer_get_time()) {}
+    ~EnergyScope() { Energy.add(subsystem, esp_timer_get_time() - start); }
+
+  private:
+    EnergySubsystem subsystem;
+    int64_t start;
+};
+
+#endif // ENERGY_h
@@ -0,0 +1,194 @@
+/**
+ * @file envsensor.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Non blocking temperature and pressure readings of a BMP180 or BMP280
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "envsensor.h"
+#include "rtcclock.h"
+#include "energy.h"
+
+// Registers of the BMP180 datasheet
+#define BMP180_REG_CALIBRATION 0xAA
+#define BMP180_REG_CHIPID 0xD0
+#define BMP180_REG_CONTROL 0xF4
+#define BMP180_REG_RESULT 0xF6
+#define BMP180_CHIPID 0x55
+#define BMP180_CMD_TEMPERATURE 0x2E
+#define BMP180_CMD_PRESSURE 0x34
+
+#define BMP280_REG_CONTROL 0xF4
+
+EnvSensorClass EnvSensor;
+
+bool EnvSensorClass::begin(uint8_t sensor) {
+  type = ENV_SENSOR_NONE;
+  state = IDLE;
+  bool found = false;
+  if (sensor == ENV_SENSOR_BMP180) found = beginBmp180();
+  else if (sensor == ENV_SENSOR_BMP280) found = beginBmp280();
+  if (!found) return false;
+
+  // Converts while the remaining setup() runs
+  type = sensor;
+  start(runtime());
+  return true;
+}
+
+bool EnvSensorClass::beginBmp180() {
+  Wire.begin();
+  uint8_t id = 0;
+  if (!readRegisters(BMP180_ADDRESS, BMP180_REG_CHIPID, &id, 1) || id != BMP180_CHIPID) return false;
+
+  // 11 big endian words
+  uint8_t raw[22];
+  if (!readRegisters(BMP180_ADDRESS, BMP180_REG_CALIBRATION, raw, sizeof(raw))) return false;
+  auto word = [&](uint8_t i) { return (uint16_t)(raw[i * 2] << 8 | raw[i * 2 + 1]); };
+  bmp180.ac1 = word(0);
+  bmp180.ac2 = word(1);
+  bmp180.ac3 = word(2);
+  bmp180.ac4 = word(3);
+  bmp180.ac5 = word(4);
+  bmp180.ac6 = word(5);
+  bmp180.b1 = word(6);
+  bmp180.b2 = word(7);
+  bmp180.mb = word(8);
+  bmp180.mc = word(9);
+  bmp180.md = word(10);
+  return true;
+}
+
+bool EnvSensorClass::beginBmp280() {
+  if (!bmp280.begin(BMP280_ADDRESS_ALT)) return false;
+  // Sleep until a forced measurement is triggered. The IIR filter is off, with a
+  // reading every few seconds it would only delay the response to changes.
+  bmp280.setSampling(Adafruit_BMP280::MODE_SLEEP,      /* Operating Mode. */
+                      Adafruit_BMP280::SAMPLING_X2,     /* Temp. oversampling */
+                      Adafruit_BMP280::SAMPLING_X16,    /* Pressure oversampling */
+                      Adafruit_BMP280::FILTER_OFF,      /* Filtering. */
+                      Adafruit_BMP280::STANDBY_MS_1);   /* Standby time, unused in forced mode. */
+  return true;
+}
+
+// Only start() and collect() are accounted to ENERGY_BMP, the sensor converts while the CPU does other work
+void EnvSensorClass::start(uint64_t now) {
+  EnergyScope energy(ENERGY_BMP);
+  lastStart = now;
+  if (type == ENV_SENSOR_BMP180) {
+    if (!writeRegister(BMP180_ADDRESS, BMP180_REG_CONTROL, BMP180_CMD_TEMPERATURE)) return;
+    state = TEMPERATURE;
+    readyAt = now + BMP180_TEMPERATURE_MS;
+  } else if (type == ENV_SENSOR_BMP280) {
+    // One measurement in forced mode, the sensor goes back to sleep afterwards
+    uint8_t control = Adafruit_BMP280::SAMPLING_X2 << 5 | Adafruit_BMP280::SAMPLING_X16 << 2 | Adafruit_BMP280::MODE_FORCED;
+    if (!writeRegister(BMP280_ADDRESS_ALT, BMP280_REG_CONTROL, control)) return;
+    state = PRESSURE;
+    readyAt = now + BMP280_MEASUREMENT_MS;
+  }
+}
+
+void EnvSensorClass::collect(uint64_t now) {
+  EnergyScope energy(ENERGY_BMP);
+  if (type == ENV_SENSOR_BMP180) {
+    uint8_t raw[3];
+    if (state == TEMPERATURE) {
+      if (!readRegisters(BMP180_ADDRESS, BMP180_REG_RESULT, raw, 2)) {
+        state = IDLE;
+        return;
+      }
+      bmp180RawTemperature = raw[0] << 8 | raw[1];
+      if (!writeRegister(BMP180_ADDRESS, BMP180_REG_CONTROL, BMP180_CMD_PRESSURE + (BMP180_OVERSAMPLING << 6))) {
+        state = IDLE;
+        return;
+      }
+      state = PRESSURE;
+      readyAt = now + BMP180_PRESSURE_MS;
+      return;
+    }
+    state = IDLE;
+    if (!readRegisters(BMP180_ADDRESS, BMP180_REG_RESULT, raw, 3)) return;
+    bmp180Compensate((raw[0] << 16 | raw[1] << 8 | raw[2]) >> (8 - BMP180_OVERSAMPLING));
+  } else if (type == ENV_SENSOR_BMP280) {
+    // Only reads the result registers, no new conversion is started
+    state = IDLE;
+    reading.temperature = bmp280.readTemperature();
+    reading.pressure = bmp280.readPressure() / 100.f;
+  }
+  reading.time = now;
+}
+
+// Integer calculation of the BMP180 datasheet
+void EnvSensorClass::bmp180Compensate(int32_t up) {
+  int32_t x1 = (bmp180RawTemperature - (int32_t)bmp180.ac6) * (int32_t)bmp180.ac5 >> 15;
+  int32_t x2 = ((int32_t)bmp180.mc << 11) / (x1 + bmp180.md);
+  int32_t b5 = x1 + x2;
+  reading.temperature = ((b5 + 8) >> 4) / 10.f;
+
+  int32_t b6 = b5 - 4000;
+  x1 = (bmp180.b2 * (b6 * b6 >> 12)) >> 11;
+  x2 = bmp180.ac2 * b6 >> 11;
+  int32_t x3 = x1 + x2;
+  int32_t b3 = ((((int32_t)bmp180.ac1 * 4 + x3) << BMP180_OVERSAMPLING) + 2) / 4;
+  x1 = bmp180.ac3 * b6 >> 13;
+  x2 = (bmp180.b1 * (b6 * b6 >> 12)) >> 16;
+  x3 = ((x1 + x2) + 2) >> 2;
+  uint32_t b4 = (uint32_t)bmp180.ac4 * (uint32_t)(x3 + 32768) >> 15;
+  uint32_t b7 = ((uint32_t)up - b3) * (uint32_t)(50000 >> BMP180_OVERSAMPLING);
+  int32_t p = b7 < 0x80000000 ? (b7 * 2) / b4 : (b7 / b4) * 2;
+  x1 = (p >> 8) * (p >> 8);
+  x1 = (x1 * 3038) >> 16;
+  x2 = (-7357 * p) >> 16;
+  p += (x1 + x2 + 3791) >> 4;
+  reading.pressure = p / 100.f;
+}
+
+void EnvSensorClass::loop() {
+  if (type == ENV_SENSOR_NONE) return;
+  uint64_t now = runtime();
+  if (state != IDLE) {
+    if (now >= readyAt) collect(now);
+  } else if (now - lastStart >= intervalMs) start(now);
+}
+
+uint32_t EnvSensorClass::msUntilNextEvent() {
+  if (type == ENV_SENSOR_NONE) return UINT32_MAX;
+  uint64_t now = runtime();
+  if (state != IDLE) return readyAt > now ? readyAt - now : 0;
+  uint64_t elapsed = now - lastStart;
+  return elapsed >= intervalMs ? 0 : intervalMs - elapsed;
+}
+
+bool EnvSensorClass::isRecent(const EnvReading &r) {
+  return r.time != 0 && runtime() - r.time <= (uint64_t)intervalMs * ENV_MAX_AGE_INTERVALS;
+}
+
+void EnvSensorClass::completePending() {
+  while (state != IDLE) {
+    uint64_t now = runtime();
+    if (now < readyAt) delay(readyAt - now);
+    collect(runtime());
+  }
+}
+
+bool EnvSensorClass::writeRegister(uint8_t address, uint8_t reg, uint8_t value) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  Wire.write(value);
+  return Wire.endTransmission() == 0;
+}
+
+bool EnvSensorClass::readRegisters(uint8_t address, uint8_t reg, uint8_t * buffer, uint8_t len) {
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom(address, len) != len) return false;
+  for (uint8_t i = 0; i < len; i++) buffer[i] = Wire.read();
+  return true;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file envsensor.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Non blocking temperature and pressure readings of a BMP180 or BMP280
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef ENVSENSOR_h
+#define ENVSENSOR_h
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_BMP280.h>
+
+// Environment sensor types, also stored in NVS
+#define ENV_SENSOR_UNKNOWN 0
+#define ENV_SENSOR_NONE 1
+#define ENV_SENSOR_BMP180 2
+#define ENV_SENSOR_BMP280 3
+
+#define BMP180_ADDRESS 0x77
+#define BMP180_OVERSAMPLING 3                   // ultra high resolution
+#define BMP180_TEMPERATURE_MS 5                 // max. conversion time (4.5ms)
+#define BMP180_PRESSURE_MS 26                   // max. conversion time with 8 samples (25.5ms)
+#define BMP280_MEASUREMENT_MS 44                // max. conversion time with 2x temperature and 16x pressure (43.2ms)
+#define ENV_MAX_AGE_INTERVALS 3                 // older readings are not used, the sensor stopped responding
+
+struct EnvReading {
+  float pressure;                               // hPa
+  float temperature;                            // °C
+  uint64_t time;                                // runtime at the end of the conversion, 0 if never read
+};
+
+class EnvSensorClass {
+  public:
+    // Initialize the sensor of the given type and start the first measurement
+    bool begin(uint8_t type);
+
+    // ENV_SENSOR_NONE until begin() succeeds
+    uint8_t getType() { return type; }
+
+    // Time between two measurements, the sensor sleeps in between
+    void setInterval(uint32_t ms) { intervalMs = ms; }
+
+    // Start a due measurement or collect a finished conversion, never waits for the sensor
+    void loop();
+
+    // Time in ms until loop() has something to do
+    uint32_t msUntilNextEvent();
+
+    // Wait for a running measurement to complete, used before deep sleep
+    void completePending();
+
+    // The latest reading, check time to see if there was one
+    EnvReading getReading() { return reading; }
+
+    // True if the reading exists and is at most ENV_MAX_AGE_INTERVALS intervals old
+    bool isRecent(const EnvReading &r);
+
+  private:
+    enum State { IDLE, TEMPERATURE, PRESSURE };
+
+    uint8_t type = ENV_SENSOR_NONE;
+    State state = IDLE;
+    uint32_t intervalMs = 5000;
+    uint64_t lastStart = 0;                     // runtime of the last measurement start
+    uint64_t readyAt = 0;                       // runtime when the running conversion is done
+
+    EnvReading reading = {0.f, 0.f, 0};
+
+    Adafruit_BMP280 bmp280;
+
+    // BMP180 calibration from its EEPROM and the raw temperature of the running measurement
+    struct {
+      int16_t ac1, ac2, ac3;
+      uint16_t ac4, ac5, ac6;
+      int16_t b1, b2, mb, mc, md;
+    } bmp180;
+    int32_t bmp180RawTemperature = 0;
+
+    bool beginBmp180();
+    bool beginBmp280();
+    void start(uint64_t now);
+    void collect(uint64_t now);
+    void bmp180Compensate(int32_t rawPressure);
+
+    bool writeRegister(uint8_t address, uint8_t reg, uint8_t value);
+    bool readRegisters(uint8_t address, uint8_t reg, uint8_t * buffer, uint8_t len);
+};
+
+extern EnvSensorClass EnvSensor;
+
+#endif // ENVSENSOR_h
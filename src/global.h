@@ -21,6 +21,9 @@
 #include "MQTTclient.h"
 #include "wifimanager.h"
 #include "otaWebUpdater.h"
+#include "webui.h"
+#include "seqlock.h"
+#include "rtcclock.h"
 
 #define webserverPort 80                    // Start the Webserver on this port
 #define NVS_NAMESPACE "gaslevel"            // Preferences.h namespace to store settings
@@ -51,6 +54,32 @@ SCALEMANAGER * LevelManagers[LEVELMANAGERS] = {
   &LevelManager2
 };
 
+// loop() runs on the Arduino core and samples the sensors, WiFi and BLE run on the other one.
+// Slow network calls must not delay the HX711 readings, the output is published from that core.
+#ifndef ARDUINO_RUNNING_CORE
+  #define ARDUINO_RUNNING_CORE 1
+#endif
+#define SAMPLING_CORE ARDUINO_RUNNING_CORE
+#if CONFIG_FREERTOS_UNICORE
+  #define OUTPUT_CORE 0
+#else
+  #define OUTPUT_CORE (1 - ARDUINO_RUNNING_CORE)
+#endif
+
+// Values of one sampling run, passed from loop() to the output task
+struct StatusSnapshot {
+  bool environment;                         // pressure and temperature are set, see EnvSensorClass::isRecent()
+  float pressure;
+  float temperature;
+  struct {
+    uint32_t sensorValue;
+    uint32_t gasWeight;
+    uint8_t level;
+    bool configured;
+  } scales[LEVELMANAGERS];
+};
+SeqLock<StatusSnapshot> statusSnapshot;
+
 WIFIMANAGER WifiManager;
 bool enableWifi = true;                     // Enable Wifi, disable to reduce power consumtion, stored in NVS
 
@@ -65,14 +94,11 @@ uint32_t blePin;
 DNSServer dnsServer;
 AsyncWebServer webServer(webserverPort);
 AsyncEventSource events("/api/events");
+WebUiHandler webUi;
 Preferences preferences;
 
 MQTTclient Mqtt;
 
-uint64_t runtime() {
-  return rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get()) / 1000;
-}
-
 String uint64ToString(uint64_t input) {
   String result = "";
   uint8_t base = 10;
@@ -0,0 +1,113 @@
+/**
+ * @file history.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Persistent history of the scale levels in LittleFS segments
+ * @version 0.1
+ * @date 2023-02-14
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "history.h"
+#include <time.h>
+#include "rtcclock.h"
+
+HistoryClass History;
+
+// Kept in RTC memory, otherwise every wake from deep sleep would add a record.
+RTC_DATA_ATTR static struct history_schedule_t {
+  uint64_t lastRecord[HISTORY_MAX_SCALES];      // runtime of the last record per scale
+  bool recorded[HISTORY_MAX_SCALES];
+} schedule;
+
+String HistoryClass::segmentPath(uint32_t segment) {
+  return String(HISTORY_DIR) + "/" + String(segment) + ".bin";
+}
+
+bool HistoryClass::begin(fs::FS &fs) {
+  if (!fs.exists(HISTORY_DIR) && !fs.mkdir(HISTORY_DIR)) return false;
+  if (lock == NULL) lock = xSemaphoreCreateMutex();
+  if (lock == NULL) return false;
+
+  // Segment n holds the records n * HISTORY_SEGMENT_RECORDS and following
+  File dir = fs.open(HISTORY_DIR);
+  if (!dir) return false;
+  int64_t first = -1, last = -1;
+  size_t lastSize = 0;
+  for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+    String name = file.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    int64_t segment = name.toInt();
+    if (first < 0 || segment < first) first = segment;
+    if (segment > last) {
+      last = segment;
+      lastSize = file.size();
+    }
+  }
+  if (last >= 0) {
+    firstIndex = first * HISTORY_SEGMENT_RECORDS;
+    nextIndex = last * HISTORY_SEGMENT_RECORDS + min(lastSize / sizeof(HistoryRecord), (size_t)HISTORY_SEGMENT_RECORDS);
+  }
+  filesystem = &fs;
+  return true;
+}
+
+void HistoryClass::add(uint8_t scale, uint8_t level, uint32_t gasWeight) {
+  if (filesystem == nullptr || scale >= HISTORY_MAX_SCALES) return;
+  uint64_t now = runtime();
+  if (schedule.recorded[scale] && now - schedule.lastRecord[scale] < HISTORY_INTERVAL_MS) return;
+  schedule.recorded[scale] = true;
+  schedule.lastRecord[scale] = now;
+
+  HistoryRecord record;
+  record.time = time(NULL);
+  record.scale = scale;
+  record.level = level;
+  record.gasWeight = min(gasWeight, (uint32_t)UINT16_MAX);
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  uint32_t segment = nextIndex / HISTORY_SEGMENT_RECORDS;
+  if (nextIndex % HISTORY_SEGMENT_RECORDS == 0 && segment >= HISTORY_SEGMENTS) {
+    // Starting a new segment, remove the one that falls out of the window
+    filesystem->remove(segmentPath(segment - HISTORY_SEGMENTS));
+    firstIndex = (segment - HISTORY_SEGMENTS + 1) * HISTORY_SEGMENT_RECORDS;
+  }
+  File file = filesystem->open(segmentPath(segment), FILE_APPEND);
+  if (file && file.write((const uint8_t *)&record, sizeof(record)) == sizeof(record)) nextIndex++;
+  file.close();
+  xSemaphoreGive(lock);
+}
+
+size_t HistoryClass::read(uint32_t &index, HistoryRecord * records, size_t count) {
+  if (filesystem == nullptr) return 0;
+  size_t done = 0;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (index < firstIndex) index = firstIndex;
+  uint32_t pos = index;
+  while (done < count && pos < nextIndex) {
+    File file = filesystem->open(segmentPath(pos / HISTORY_SEGMENT_RECORDS), FILE_READ);
+    if (!file || !file.seek((pos % HISTORY_SEGMENT_RECORDS) * sizeof(HistoryRecord))) break;
+
+    // Read up to the end of this segment
+    size_t wanted = min(count - done, (size_t)min(nextIndex - pos, HISTORY_SEGMENT_RECORDS - pos % HISTORY_SEGMENT_RECORDS));
+    size_t n = file.read((uint8_t *)(records + done), wanted * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    file.close();
+    done += n;
+    pos += n;
+    if (n < wanted) break;
+  }
+  xSemaphoreGive(lock);
+  return done;
+}
+
+uint32_t HistoryClass::getFirstIndex() {
+  return firstIndex;
+}
+
+uint32_t HistoryClass::getNextIndex() {
+  return nextIndex;
+}
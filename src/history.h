@@ -0,0 +1,61 @@
+/**
+ * @file history.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Persistent history of the scale levels in LittleFS segments
+ * @version 0.1
+ * @date 2023-02-14
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef HISTORY_h
+#define HISTORY_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define HISTORY_DIR "/history"                  // Directory of the history segments
+#define HISTORY_INTERVAL_MS (5 * 60 * 1000)     // Store a record per scale every 5 minutes
+#define HISTORY_SEGMENT_RECORDS 1024            // Records per segment file (8KB)
+#define HISTORY_SEGMENTS 8                      // Number of segments to keep, 4 scales for a week
+#define HISTORY_MAX_SCALES 4
+
+// Stored and transferred as is, little endian
+struct HistoryRecord {
+  uint32_t time;                                // time(), seconds since boot if the clock was never set
+  uint8_t scale;
+  uint8_t level;                                // percent
+  uint16_t gasWeight;                           // gramms
+};
+
+class HistoryClass {
+  public:
+    // Find the segments on the filesystem, returns false if the history can't be stored
+    bool begin(fs::FS &fs);
+
+    // Append a record if the last one of this scale is older than the interval
+    void add(uint8_t scale, uint8_t level, uint32_t gasWeight);
+
+    // Copy up to count records starting at index, returns the number of records read.
+    // If the records at index are already deleted, index is moved to the first available one.
+    size_t read(uint32_t &index, HistoryRecord * records, size_t count);
+
+    // Every record has a unique, increasing index. Records before the first index are deleted.
+    uint32_t getFirstIndex();
+    uint32_t getNextIndex();
+
+  private:
+    fs::FS * filesystem = nullptr;
+    SemaphoreHandle_t lock = NULL;              // held during file access
+    uint32_t firstIndex = 0;
+    uint32_t nextIndex = 0;
+
+    String segmentPath(uint32_t segment);
+};
+
+extern HistoryClass History;
+
+#endif // HISTORY_h
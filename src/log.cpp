@@ -0,0 +1,167 @@
+/**
+ * @file log.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Leveled logging to Serial and WebSerial
+ * @version 0.1
+ * @date 2023-02-07
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "log.h"
+
+uint8_t logLevel = LOG_LEVEL;
+uint32_t logModules = UINT32_MAX;
+
+#ifdef LOG_DEFERRED
+
+#define LOG_RECORD_HEADER (3 + sizeof(const char *))
+
+static uint8_t ring[LOG_DEFERRED_BUFFER_SIZE];
+static uint32_t ringHead = 0;                       // free running counters
+static uint32_t ringTail = 0;
+static portMUX_TYPE ringMux = portMUX_INITIALIZER_UNLOCKED;
+
+LogRecord::LogRecord(uint8_t level, uint8_t module, const char * format) {
+  data[1] = level;
+  data[2] = module;
+  memcpy(data + 3, &format, sizeof(format));
+  len = LOG_RECORD_HEADER;
+}
+
+void LogRecord::put(uint8_t tag, const void * value, size_t size) {
+  if (len + 1 + size > sizeof(data)) return;
+  data[len++] = tag;
+  memcpy(data + len, value, size);
+  len += size;
+}
+
+void LogRecord::addString(const char * v) {
+  if (v == nullptr) v = "(null)";
+  if (len + 3 > sizeof(data)) return;
+  size_t n = min(strlen(v), sizeof(data) - len - 2);
+  data[len++] = LOG_ARG_STRING;
+  data[len++] = n;
+  memcpy(data + len, v, n);
+  len += n;
+}
+
+void logCommit(LogRecord &r) {
+  uint8_t * record = r.data;
+  record[0] = r.len;
+
+  portENTER_CRITICAL(&ringMux);
+  if (LOG_DEFERRED_BUFFER_SIZE - (ringHead - ringTail) >= r.len) {
+    for (size_t i = 0; i < r.len; i++) ring[(ringHead + i) % LOG_DEFERRED_BUFFER_SIZE] = record[i];
+    ringHead += r.len;
+  }
+  portEXIT_CRITICAL(&ringMux);
+}
+
+// Writes a single conversion like "%-5.2lf" with the given argument, returns the new position
+static size_t formatArg(char * out, size_t pos, size_t outSize, const char * spec, size_t specLen, const uint8_t * arg, uint8_t tag) {
+  char fmt[16];
+  size_t n = 0;
+  char conversion = spec[specLen - 1];
+
+  // Copy flags, width and precision, length modifiers are replaced by our own
+  for (size_t i = 0; i < specLen - 1 && n < sizeof(fmt) - 4; i++) {
+    if (strchr("hlLqjzt", spec[i]) == nullptr) fmt[n++] = spec[i];
+  }
+
+  int written = 0;
+  size_t avail = outSize - pos;
+  if (tag == LOG_ARG_STRING) {
+    char str[LOG_DEFERRED_RECORD_SIZE];
+    memcpy(str, arg + 1, arg[0]);
+    str[arg[0]] = '\0';
+    fmt[n++] = 's'; fmt[n] = '\0';
+    written = snprintf(out + pos, avail, fmt, str);
+  } else if (tag == LOG_ARG_DOUBLE) {
+    double v;
+    memcpy(&v, arg, sizeof(v));
+    fmt[n++] = strchr("fFeEgGaA", conversion) ? conversion : 'f'; fmt[n] = '\0';
+    written = snprintf(out + pos, avail, fmt, v);
+  } else if (tag == LOG_ARG_POINTER) {
+    const void * v;
+    memcpy(&v, arg, sizeof(v));
+    fmt[n++] = 'p'; fmt[n] = '\0';
+    written = snprintf(out + pos, avail, fmt, v);
+  } else {
+    uint64_t v;
+    memcpy(&v, arg, sizeof(v));
+    if (strchr("fFeEgGaA", conversion)) {
+      fmt[n++] = conversion; fmt[n] = '\0';
+      written = snprintf(out + pos, avail, fmt, tag == LOG_ARG_SIGNED ? (double)(int64_t)v : (double)v);
+    } else if (conversion == 'c') {
+      fmt[n++] = 'c'; fmt[n] = '\0';
+      written = snprintf(out + pos, avail, fmt, (int)v);
+    } else {
+      fmt[n++] = 'l'; fmt[n++] = 'l';
+      fmt[n++] = strchr("diouxX", conversion) ? conversion : 'd'; fmt[n] = '\0';
+      written = snprintf(out + pos, avail, fmt, v);
+    }
+  }
+  if (written < 0) return pos;
+  return min(pos + written, outSize - 1);
+}
+
+size_t logFormatRecord(const uint8_t * record, size_t len, char * out, size_t outSize) {
+  const char * format;
+  memcpy(&format, record + 3, sizeof(format));
+  size_t argPos = LOG_RECORD_HEADER;
+  size_t pos = 0;
+
+  for (const char * p = format; *p && pos < outSize - 1; p++) {
+    if (*p != '%') {
+      out[pos++] = *p;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[pos++] = '%';
+      p++;
+      continue;
+    }
+    // find the conversion character
+    size_t specLen = 1;
+    while (p[specLen] && strchr("diouxXcsfFeEgGaAp", p[specLen]) == nullptr) specLen++;
+    if (!p[specLen]) break;
+    specLen++;
+
+    if (argPos < len) {
+      uint8_t tag = record[argPos++];
+      pos = formatArg(out, pos, outSize, p, specLen, record + argPos, tag);
+      argPos += (tag == LOG_ARG_STRING) ? record[argPos] + 1 : (tag == LOG_ARG_POINTER ? sizeof(void *) : 8);
+    }
+    p += specLen - 1;
+  }
+  out[pos] = '\0';
+  return pos;
+}
+
+void logDrainDeferred() {
+  uint8_t record[LOG_DEFERRED_RECORD_SIZE];
+  char line[LOG_DEFERRED_LINE_SIZE];
+
+  for(;;) {
+    // Take one record at a time, several tasks may drain concurrently
+    portENTER_CRITICAL(&ringMux);
+    size_t len = 0;
+    if (ringHead != ringTail) {
+      len = ring[ringTail % LOG_DEFERRED_BUFFER_SIZE];
+      for (size_t i = 0; i < len; i++) record[i] = ring[(ringTail + i) % LOG_DEFERRED_BUFFER_SIZE];
+      ringTail += len;
+    }
+    portEXIT_CRITICAL(&ringMux);
+    if (len == 0) return;
+
+    size_t textLen = logFormatRecord(record, len, line, sizeof(line));
+    Serial.write((const uint8_t *)line, textLen);
+    WebSerial.write(line, textLen);
+  }
+}
+
+#endif // LOG_DEFERRED
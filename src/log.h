@@ -1,25 +1,147 @@
+/**
+ * @file log.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Leveled logging to Serial and WebSerial
+ * @version 0.1
+ * @date 2023-02-07
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * Everything above the build flag LOG_LEVEL (default LOG_LEVEL_INFO) is removed at compile time.
+ * The remaining messages are filtered at runtime by logLevel and the per module bit mask logModules.
+ * Define LOG_MODULE before including this file to assign the messages of a file to a module.
+ * Arguments are only evaluated for messages that pass both filters, and may be evaluated once
+ * per sink. They must never have side effects, e.g. resetting a value has to be its own statement.
+ *
+ * With -DLOG_DEFERRED the *_F macros only store the format pointer and the raw arguments
+ * into a binary buffer, the text is created when logDrainDeferred() hands it to the sinks.
+ */
 
+#ifndef LOG_h
+#define LOG_h
 
 #include "webserial.h"
 extern WebSerialClass WebSerial;
 
-#ifndef LOG_INFO
-  #define LOG_INFO(...)  do {     \
-    Serial.print(__VA_ARGS__);    \
-    WebSerial.print(__VA_ARGS__); \
-    } while(0)
-#endif // LOG_INFO(...)
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DEBUG 4
+#define LOG_LEVEL_TRACE 5
 
-#ifndef LOG_INFO_LN
-  #define LOG_INFO_LN(...) do {    \
-    Serial.println(__VA_ARGS__);   \
-    WebSerial.println(__VA_ARGS__);  \
-    } while(0)
-#endif // LOG_INFO_LN(...)
+#ifndef LOG_LEVEL
+  #define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+enum LogModule : uint8_t {
+  LOG_MOD_MAIN = 0,
+  LOG_MOD_SCALE,
+  LOG_MOD_SENSOR,
+  LOG_MOD_MQTT,
+  LOG_MOD_BLE,
+  LOG_MOD_WEB,
+  LOG_MOD_OTA,
+  LOG_MOD_COUNT
+};
+
+extern uint8_t logLevel;                    // Runtime level, messages above are dropped
+extern uint32_t logModules;                 // Bit mask of enabled LogModule
+
+#ifndef LOG_MODULE
+  #define LOG_MODULE LOG_MOD_MAIN
+#endif
 
-#ifndef LOG_INFO_F
-  #define LOG_INFO_F(format, ...)  do {     \
-    Serial.printf(format, __VA_ARGS__);    \
-    WebSerial.printf(format, __VA_ARGS__);  \
+#define LOG_ENABLED(level) ((level) <= logLevel && (logModules & (1UL << (LOG_MODULE))))
+
+#define LOG_PRINT(level, ...)  do {            \
+    if (LOG_ENABLED(level)) {                  \
+      Serial.print(__VA_ARGS__);               \
+      WebSerial.print(__VA_ARGS__);            \
+    }                                          \
+  } while(0)
+
+#define LOG_PRINT_LN(level, ...) do {          \
+    if (LOG_ENABLED(level)) {                  \
+      Serial.println(__VA_ARGS__);             \
+      WebSerial.println(__VA_ARGS__);          \
+    }                                          \
+  } while(0)
+
+#ifdef LOG_DEFERRED
+  #include "logdeferred.h"
+  #define LOG_PRINT_F(level, format, ...) do {                                \
+      if (LOG_ENABLED(level)) logDeferred(level, LOG_MODULE, format, ##__VA_ARGS__); \
+    } while(0)
+#else
+  #define LOG_PRINT_F(level, format, ...) do {                                \
+      if (LOG_ENABLED(level)) {                                               \
+        Serial.printf(format, ##__VA_ARGS__);                                 \
+        WebSerial.printf(format, ##__VA_ARGS__);                              \
+      }                                                                       \
     } while(0)
-#endif // LOG_INFO_F(format, ...)
+#endif
+
+#define LOG_NOOP do {} while(0)
+
+// Hand pending deferred messages to the sinks (noop without LOG_DEFERRED)
+#ifdef LOG_DEFERRED
+  #define LOG_FLUSH() logDrainDeferred()
+#else
+  #define LOG_FLUSH() LOG_NOOP
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+  #define LOG_ERROR(...)             LOG_PRINT(LOG_LEVEL_ERROR, __VA_ARGS__)
+  #define LOG_ERROR_LN(...)          LOG_PRINT_LN(LOG_LEVEL_ERROR, __VA_ARGS__)
+  #define LOG_ERROR_F(format, ...)   LOG_PRINT_F(LOG_LEVEL_ERROR, format, ##__VA_ARGS__)
+#else
+  #define LOG_ERROR(...)             LOG_NOOP
+  #define LOG_ERROR_LN(...)          LOG_NOOP
+  #define LOG_ERROR_F(format, ...)   LOG_NOOP
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+  #define LOG_WARN(...)              LOG_PRINT(LOG_LEVEL_WARN, __VA_ARGS__)
+  #define LOG_WARN_LN(...)           LOG_PRINT_LN(LOG_LEVEL_WARN, __VA_ARGS__)
+  #define LOG_WARN_F(format, ...)    LOG_PRINT_F(LOG_LEVEL_WARN, format, ##__VA_ARGS__)
+#else
+  #define LOG_WARN(...)              LOG_NOOP
+  #define LOG_WARN_LN(...)           LOG_NOOP
+  #define LOG_WARN_F(format, ...)    LOG_NOOP
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+  #define LOG_INFO(...)              LOG_PRINT(LOG_LEVEL_INFO, __VA_ARGS__)
+  #define LOG_INFO_LN(...)           LOG_PRINT_LN(LOG_LEVEL_INFO, __VA_ARGS__)
+  #define LOG_INFO_F(format, ...)    LOG_PRINT_F(LOG_LEVEL_INFO, format, ##__VA_ARGS__)
+#else
+  #define LOG_INFO(...)              LOG_NOOP
+  #define LOG_INFO_LN(...)           LOG_NOOP
+  #define LOG_INFO_F(format, ...)    LOG_NOOP
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+  #define LOG_DEBUG(...)             LOG_PRINT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+  #define LOG_DEBUG_LN(...)          LOG_PRINT_LN(LOG_LEVEL_DEBUG, __VA_ARGS__)
+  #define LOG_DEBUG_F(format, ...)   LOG_PRINT_F(LOG_LEVEL_DEBUG, format, ##__VA_ARGS__)
+#else
+  #define LOG_DEBUG(...)             LOG_NOOP
+  #define LOG_DEBUG_LN(...)          LOG_NOOP
+  #define LOG_DEBUG_F(format, ...)   LOG_NOOP
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+  #define LOG_TRACE(...)             LOG_PRINT(LOG_LEVEL_TRACE, __VA_ARGS__)
+  #define LOG_TRACE_LN(...)          LOG_PRINT_LN(LOG_LEVEL_TRACE, __VA_ARGS__)
+  #define LOG_TRACE_F(format, ...)   LOG_PRINT_F(LOG_LEVEL_TRACE, format, ##__VA_ARGS__)
+#else
+  #define LOG_TRACE(...)             LOG_NOOP
+  #define LOG_TRACE_LN(...)          LOG_NOOP
+  #define LOG_TRACE_F(format, ...)   LOG_NOOP
+#endif
+
+#endif // LOG_h
@@ -0,0 +1,96 @@
+/**
+ * @file logdeferred.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Binary log records that are formatted when a sink consumes them
+ * @version 0.1
+ * @date 2023-02-07
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef LOGDEFERRED_h
+#define LOGDEFERRED_h
+
+#include <Arduino.h>
+#include <type_traits>
+#include <utility>
+
+#define LOG_DEFERRED_BUFFER_SIZE 2048       // Ring buffer for the binary records
+#define LOG_DEFERRED_RECORD_SIZE 160        // Max size of a single record, longer strings are cut
+#define LOG_DEFERRED_LINE_SIZE 256          // Max length of a formatted message
+
+// Argument type tags inside a record
+#define LOG_ARG_SIGNED   'i'
+#define LOG_ARG_UNSIGNED 'u'
+#define LOG_ARG_DOUBLE   'd'
+#define LOG_ARG_STRING   's'
+#define LOG_ARG_POINTER  'p'
+
+// Record layout: [u8 length][u8 level][u8 module][const char * format][tag, value]...
+class LogRecord {
+  public:
+    uint8_t data[LOG_DEFERRED_RECORD_SIZE];
+    size_t len = 0;
+
+    LogRecord(uint8_t level, uint8_t module, const char * format);
+
+    void addSigned(int64_t v) { put(LOG_ARG_SIGNED, &v, sizeof(v)); }
+    void addUnsigned(uint64_t v) { put(LOG_ARG_UNSIGNED, &v, sizeof(v)); }
+    void addDouble(double v) { put(LOG_ARG_DOUBLE, &v, sizeof(v)); }
+    void addPointer(const void * v) { put(LOG_ARG_POINTER, &v, sizeof(v)); }
+    void addString(const char * v);
+
+  private:
+    void put(uint8_t tag, const void * value, size_t size);
+};
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+logPack(LogRecord &r, T v) { r.addSigned(v); }
+
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type
+logPack(LogRecord &r, T v) { r.addUnsigned(v); }
+
+template<typename T>
+typename std::enable_if<std::is_enum<T>::value>::type
+logPack(LogRecord &r, T v) { r.addSigned((int64_t)v); }
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type
+logPack(LogRecord &r, T v) { r.addDouble(v); }
+
+// Strings are copied, the caller's buffer may be gone when the record is formatted
+inline void logPack(LogRecord &r, const char * v) { r.addString(v); }
+inline void logPack(LogRecord &r, char * v) { r.addString(v); }
+inline void logPack(LogRecord &r, const String &v) { r.addString(v.c_str()); }
+inline void logPack(LogRecord &r, const void * v) { r.addPointer(v); }
+
+inline void logPackAll(LogRecord &r) {}
+
+template<typename T, typename... Args>
+void logPackAll(LogRecord &r, T&& v, Args&&... args) {
+  logPack(r, v);
+  logPackAll(r, std::forward<Args>(args)...);
+}
+
+// Store the record in the ring buffer, dropped if there is no space left
+void logCommit(LogRecord &r);
+
+// Format all stored records and write them to Serial and WebSerial
+void logDrainDeferred();
+
+// Format a single record into out, returns the length of the text
+size_t logFormatRecord(const uint8_t * record, size_t len, char * out, size_t outSize);
+
+template<typename... Args>
+void logDeferred(uint8_t level, uint8_t module, const char * format, Args&&... args) {
+  LogRecord r(level, module, format);
+  logPackAll(r, std::forward<Args>(args)...);
+  logCommit(r);
+}
+
+#endif // LOGDEFERRED_h
@@ -0,0 +1,155 @@
+/**
+ * @file logfile.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Persistent log output in rotating LittleFS files
+ * @version 0.1
+ * @date 2023-02-08
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "logfile.h"
+#include "metrics.h"
+#include <atomic>
+#include <memory>
+#include <new>
+#include "rtcclock.h"
+
+LogFileClass LogFile;
+
+// Kept in RTC memory, so nothing is lost or written to flash when going to deep sleep.
+RTC_DATA_ATTR static struct logfile_page_t {
+  char data[LOGFILE_PAGE_SIZE];
+  uint32_t len;                               // bytes used in data
+  uint32_t dropped;                           // bytes dropped since the last write
+  uint32_t seq;                               // sequence number of the current segment
+  uint64_t firstWrite;                        // runtime of the oldest byte in data
+  uint64_t lastFlush;                         // runtime of the last write to flash
+} page;
+
+static std::atomic_flag flushing = ATOMIC_FLAG_INIT;
+
+String LogFileClass::segmentPath(uint32_t seq) {
+  return String(LOGFILE_DIR) + "/" + String(seq) + ".log";
+}
+
+bool LogFileClass::begin(fs::FS &fs, uint8_t segments, uint32_t segmentSize) {
+  maxSegments = max(segments, (uint8_t)1);
+  maxSegmentSize = max(segmentSize, (uint32_t)LOGFILE_PAGE_SIZE);
+
+  if (!fs.exists(LOGFILE_DIR) && !fs.mkdir(LOGFILE_DIR)) return false;
+
+  if (page.seq == 0) {
+    // Cold boot, continue with the newest segment on the filesystem
+    File dir = fs.open(LOGFILE_DIR);
+    if (!dir) return false;
+    for (File file = dir.openNextFile(); file; file = dir.openNextFile()) {
+      String name = file.name();
+      name = name.substring(name.lastIndexOf('/') + 1);
+      page.seq = max(page.seq, (uint32_t)name.toInt());
+    }
+    if (page.seq == 0) page.seq = 1;
+  }
+
+  filesystem = &fs;
+  return true;
+}
+
+void LogFileClass::write(const char * data, size_t len) {
+  portENTER_CRITICAL(&mux);
+  if (page.len == 0) page.firstWrite = runtime();
+  size_t n = min(len, (size_t)(LOGFILE_PAGE_SIZE - page.len));
+  memcpy(page.data + page.len, data, n);
+  page.len += n;
+  page.dropped += len - n;
+  portEXIT_CRITICAL(&mux);
+}
+
+void LogFileClass::flush(bool force) {
+  if (filesystem == nullptr || page.len == 0) return;
+
+  uint64_t now = runtime();
+  if (!force) {
+    if (now - page.lastFlush < LOGFILE_MIN_FLUSH_MS) return;
+    if (page.len < LOGFILE_PAGE_SIZE && now - page.firstWrite < LOGFILE_MAX_AGE_MS) return;
+  }
+  if (flushing.test_and_set()) return;
+
+  char * buffer = (char *) malloc(LOGFILE_PAGE_SIZE);
+  if (buffer == NULL) {
+    flushing.clear();
+    return;
+  }
+  portENTER_CRITICAL(&mux);
+  size_t len = page.len;
+  uint32_t dropped = page.dropped;
+  memcpy(buffer, page.data, len);
+  page.len = 0;
+  page.dropped = 0;
+  portEXIT_CRITICAL(&mux);
+
+  File file = filesystem->open(segmentPath(page.seq), FILE_APPEND);
+  if (file && file.size() + len > maxSegmentSize) {
+    // Rotate, remove the segment that falls out of the window
+    file.close();
+    portENTER_CRITICAL(&mux);
+    page.seq++;
+    portEXIT_CRITICAL(&mux);
+    if (page.seq > maxSegments && filesystem->exists(segmentPath(page.seq - maxSegments))) {
+      filesystem->remove(segmentPath(page.seq - maxSegments));
+    }
+    file = filesystem->open(segmentPath(page.seq), FILE_WRITE);
+  }
+  if (file) {
+    file.write((const uint8_t *)buffer, len);
+    if (dropped) file.printf("\n[LOGFILE] %u bytes dropped due to rate limiting\n", dropped);
+    file.close();
+    metricLogFileWrites.inc();
+  }
+  metricLogFileDropped.inc(dropped);
+  page.lastFlush = now;
+
+  free(buffer);
+  flushing.clear();
+}
+
+AsyncWebServerResponse * LogFileClass::beginResponse(AsyncWebServerRequest *request) {
+  struct LogStream {
+    uint32_t seq;
+    File file;
+    std::unique_ptr<char[]> tail;
+    size_t tailLen = 0;
+    size_t tailPos = 0;
+  };
+  auto stream = std::make_shared<LogStream>();
+  stream->tail.reset(new (std::nothrow) char[LOGFILE_PAGE_SIZE]);
+  if (!stream->tail) return request->beginResponse(503, "text/plain", "Out of memory");
+
+  // Snapshot of the data not yet written to flash, consistent with the segment it belongs to
+  portENTER_CRITICAL(&mux);
+  uint32_t lastSeq = page.seq;
+  stream->tailLen = page.len;
+  memcpy(stream->tail.get(), page.data, page.len);
+  portEXIT_CRITICAL(&mux);
+  stream->seq = lastSeq > maxSegments ? lastSeq - maxSegments + 1 : 1;
+
+  fs::FS * fs = filesystem;
+  return request->beginChunkedResponse("text/plain", [stream, lastSeq, fs](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+    while (fs != nullptr && stream->seq <= lastSeq) {
+      if (!stream->file) stream->file = fs->open(String(LOGFILE_DIR) + "/" + String(stream->seq) + ".log", FILE_READ);
+      if (stream->file) {
+        size_t n = stream->file.read(buffer, maxLen);
+        if (n > 0) return n;
+        stream->file.close();
+      }
+      stream->seq++;
+    }
+    size_t n = min(maxLen, stream->tailLen - stream->tailPos);
+    memcpy(buffer, stream->tail.get() + stream->tailPos, n);
+    stream->tailPos += n;
+    return n;
+  });
+}
@@ -0,0 +1,56 @@
+/**
+ * @file logfile.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Persistent log output in rotating LittleFS files
+ * @version 0.1
+ * @date 2023-02-08
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef LOGFILE_h
+#define LOGFILE_h
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <FS.h>
+
+#define LOGFILE_DIR "/log"                      // Directory of the log segments
+#define LOGFILE_PAGE_SIZE 2048                  // RAM buffer (in RTC memory), written as a whole
+#define LOGFILE_SEGMENT_SIZE (32 * 1024)        // Max size of a single segment
+#define LOGFILE_SEGMENTS 4                      // Number of segments to keep
+#define LOGFILE_MIN_FLUSH_MS (60 * 1000)        // Never write more often than this
+#define LOGFILE_MAX_AGE_MS (10 * 60 * 1000)     // Write a partially filled page after this time
+
+class LogFileClass {
+  public:
+    // Find the newest segment on the filesystem, returns false if logging to files is not possible
+    bool begin(fs::FS &fs, uint8_t segments = LOGFILE_SEGMENTS, uint32_t segmentSize = LOGFILE_SEGMENT_SIZE);
+
+    // Copy data into the page buffer, data is dropped if the page is full
+    void write(const char * data, size_t len);
+
+    // Write the page buffer to the current segment if it is full or old enough.
+    // The rate limit is always respected, unless force is set.
+    void flush(bool force = false);
+
+    // Stream all segments from oldest to newest, including the unwritten page buffer
+    AsyncWebServerResponse * beginResponse(AsyncWebServerRequest *request);
+
+  private:
+    fs::FS * filesystem = nullptr;
+    uint8_t maxSegments = LOGFILE_SEGMENTS;
+    uint32_t maxSegmentSize = LOGFILE_SEGMENT_SIZE;
+
+    // Protects the page buffer, only held while copying
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    String segmentPath(uint32_t seq);
+};
+
+extern LogFileClass LogFile;
+
+#endif // LOGFILE_h
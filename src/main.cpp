@@ -42,14 +42,6 @@
 // Power Management
 #include <driver/rtc_io.h>
 #include <esp_sleep.h>
-#include <soc/rtc.h>
-extern "C" {
-  #if ESP_ARDUINO_VERSION_MAJOR >= 2
-    #include <esp32/clk.h>
-  #else
-    #include <esp_clk.h>
-  #endif
-}
 
 #define BMP_SDA 21
 #define BMP_SCL 22
@@ -57,19 +49,23 @@ extern "C" {
 #include "global.h"
 #include "api-routes.h"
 #include "ble.h"
+#include "history.h"
 #include "dac.h"
+#include "metrics.h"
+#include "logfile.h"
+#include "telemetry.h"
+#include "energy.h"
+#include "boot.h"
+#include "config.h"
 
-#include <Adafruit_Sensor.h>
-#include <Adafruit_BMP085_U.h>
-Adafruit_BMP085_Unified bmp180 = Adafruit_BMP085_Unified(10085);
+#include "envsensor.h"
 
-bool bmp180_found = false;
+// Environment sensor found on the last boot, also stored in NVS
+RTC_DATA_ATTR uint8_t envSensor = ENV_SENSOR_UNKNOWN;
 
-#include <Adafruit_BMP280.h>
-bool bmp280_found = false;
-Adafruit_BMP280 bmp280; // use I2C interface
-Adafruit_Sensor *bmp280_temp = bmp280.getTemperatureSensor();
-Adafruit_Sensor *bmp280_pressure = bmp280.getPressureSensor();
+// Given once LittleFS is mounted, see mountFilesystemTask()
+SemaphoreHandle_t filesystemReady = NULL;
+bool filesystemMounted = false;
 
 /*
 // Experimental to connect the weight module via 4 cables intead of 5
@@ -80,12 +76,36 @@ DallasTemperature sensors(&oneWire);
 */
 WebSerialClass WebSerial;
 
+// loop() samples all sensors on SAMPLING_CORE and blocks on a task notification until
+// the next deadline, see sleepOrDelay(). The outputTask on OUTPUT_CORE publishes the values.
+TaskHandle_t loopTaskHandle = NULL;
+TaskHandle_t outputTaskHandle = NULL;
+
 void IRAM_ATTR ISR_button1() {
   button1.pressed = true;
+  if (loopTaskHandle == NULL) return;
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(loopTaskHandle, &woken);
+  if (woken) portYIELD_FROM_ISR();
+}
+
+// Time in ms until loop() has to take the next sample
+uint32_t msUntilNextDeadline() {
+  uint64_t now = runtime();
+  uint64_t wait = 0;
+  if (now - Timing.lastStatusUpdate < Timing.statusUpdateInterval) {
+    wait = Timing.lastStatusUpdate + Timing.statusUpdateInterval - now;
+  }
+  for (uint8_t i=0; i < LEVELMANAGERS; i++) {
+    wait = min(wait, (uint64_t)LevelManagers[i]->msUntilNextRead());
+  }
+  wait = min(wait, (uint64_t)EnvSensor.msUntilNextEvent());
+  return wait;
 }
 
 void deepsleepForSeconds(int seconds) {
     esp_sleep_enable_timer_wakeup(seconds * uS_TO_S_FACTOR);
+    Energy.enterDeepSleep();
     esp_deep_sleep_start();
 }
 
@@ -93,18 +113,25 @@ void deepsleepForSeconds(int seconds) {
 // deep sleep mode of our ESP32 chip.
 void sleepOrDelay() {
   if (enableWifi || enableBle || enableMqtt) {
-    yield();
-    delay(50);
+    // Block until the next deadline or an event like the button instead of polling.
+    // The deadlines are checked in loop().
+    uint32_t wait = msUntilNextDeadline();
+    if (otaWebUpdater.otaIsRunning) wait = min(wait, (uint32_t)1000);
+    if (wait) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(wait) + 1);
+    else yield();
   } else {
     // We can save a lot of power by going into deepsleep
     // Thid disables WIFI and everything.
     esp_sleep_enable_timer_wakeup(TIME_TO_SLEEP * uS_TO_S_FACTOR);
-    sleepTime = rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get());
+    sleepTime = rtcMicros();
     rtc_gpio_pullup_en(button1.PIN);
     rtc_gpio_pulldown_dis(button1.PIN);
     esp_sleep_enable_ext0_wakeup(button1.PIN, 0);
 
     LOG_INFO_LN(F("[POWER] Sleeping..."));
+    // Move pending output into the RTC page, it is only written to flash once the rate limit allows it
+    WebSerial.flush();
+    Energy.enterDeepSleep();
     esp_deep_sleep_start();
   }
 }
@@ -122,10 +149,9 @@ void print_wakeup_reason() {
     case ESP_SLEEP_WAKEUP_TIMER : 
       LOG_INFO_LN(F("[POWER] Wakeup caused by timer"));
       uint64_t timeNow, timeDiff;
-      timeNow = rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get());
+      timeNow = rtcMicros();
       timeDiff = timeNow - sleepTime;
       printf("Now: %" PRIu64 "ms, Duration: %" PRIu64 "ms\n", timeNow / 1000, timeDiff / 1000);
-      delay(2000);
     break;
     case ESP_SLEEP_WAKEUP_TOUCHPAD : LOG_INFO_LN(F("[POWER] Wakeup caused by touchpad")); break;
     case ESP_SLEEP_WAKEUP_ULP : LOG_INFO_LN(F("[POWER] Wakeup caused by ULP program")); break;
@@ -133,6 +159,61 @@ void print_wakeup_reason() {
   }
 }
 
+void startMdns(arduino_event_id_t event) {
+  static bool started = false;
+  if (started) return;
+  started = true;
+
+  LOG_INFO_LN(F("[MDNS] Starting mDNS Service!"));
+  MDNS.begin(hostname.c_str());
+  MDNS.addService("http", "tcp", 80);
+  MDNS.addService("ota", "udp", 3232);
+  LOG_INFO_F("[MDNS] You should be able now to open http://%s.local/ in your browser.\n", hostname.c_str());
+}
+
+// Runs in parallel to the remaining setup(), see filesystemReady
+void mountFilesystem() {
+  BootStage stage("littlefs");
+  filesystemMounted = LittleFS.begin(true);
+  if (!filesystemMounted) return;
+  LOG_INFO_LN(F("[LITTLEFS] initialized"));
+
+  if (LogFile.begin(LittleFS)) WebSerial.startBackgroundTask();
+  else LOG_WARN_LN(F("[LOGFILE] Unable to write log files"));
+  if (!History.begin(LittleFS)) LOG_WARN_LN(F("[HISTORY] Unable to store the history"));
+}
+
+void mountFilesystemTask(void* param) {
+  mountFilesystem();
+  xSemaphoreGive(filesystemReady);
+  vTaskDelete(NULL);
+}
+
+// Probing a missing sensor takes time, start with the one found before.
+// After deep sleep, the result of the last boot is used without probing.
+void beginEnvironmentSensor() {
+  BootStage stage("sensor");
+  bool wakeup = envSensor != ENV_SENSOR_UNKNOWN;
+  if (!wakeup) envSensor = preferences.getUChar("envSensor", ENV_SENSOR_UNKNOWN);
+  uint8_t known = envSensor;
+
+  EnvSensor.setInterval(Timing.statusUpdateInterval);
+  if (known == ENV_SENSOR_BMP180 || known == ENV_SENSOR_BMP280) EnvSensor.begin(known);
+  else if (known == ENV_SENSOR_NONE && wakeup) return;
+
+  if (EnvSensor.getType() == ENV_SENSOR_NONE) {
+    if (known != ENV_SENSOR_BMP180) EnvSensor.begin(ENV_SENSOR_BMP180);
+    if (EnvSensor.getType() == ENV_SENSOR_NONE) {
+      LOG_INFO_LN(F("[BMP180] Chip not found, trying BMP280 next"));
+      if (known != ENV_SENSOR_BMP280) EnvSensor.begin(ENV_SENSOR_BMP280);
+      if (EnvSensor.getType() == ENV_SENSOR_NONE) LOG_INFO_LN(F("[BMP280] Chip not found, disabling temperature and pressure"));
+    }
+  }
+
+  envSensor = EnvSensor.getType();
+  if (envSensor != known) preferences.putUChar("envSensor", envSensor);
+}
+
 void initWifiAndServices() {
   if (enableOtaWebUpdate) {
     otaWebUpdater.setFirmware(AUTO_FW_DATE, AUTO_FW_VERSION);
@@ -143,34 +224,128 @@ void initWifiAndServices() {
   // Load well known Wifi AP credentials from NVS
   WifiManager.startBackgroundTask();
   WifiManager.attachWebServer(&webServer);
-  WifiManager.fallbackToSoftAp(preferences.getBool("enableSoftAp", true));
+  WifiManager.fallbackToSoftAp(Config.get().enableSoftAp);
 
   WebSerial.begin(&webServer);
+  Telemetry.startBackgroundTask();
 
   APIRegisterRoutes();
   webServer.begin();
   LOG_INFO_LN(F("[WEB] HTTP server started"));
 
   if (enableWifi) {
-    LOG_INFO_LN(F("[MDNS] Starting mDNS Service!"));
-    MDNS.begin(hostname.c_str());
-    MDNS.addService("http", "tcp", 80);
-    MDNS.addService("ota", "udp", 3232);
-    LOG_INFO_F("[MDNS] You should be able now to open http://%s.local/ in your browser.\n", hostname);
+    // Started once the network is up, nothing to announce before
+    WiFi.onEvent(startMdns, ARDUINO_EVENT_WIFI_STA_GOT_IP);
+    WiFi.onEvent(startMdns, ARDUINO_EVENT_WIFI_AP_START);
   }
 
   if (enableMqtt) {
-    Mqtt.prepare(
-      preferences.getString("mqttHost", "localhost"),
-      preferences.getUInt("mqttPort", 1883),
-      preferences.getString("mqttTopic", "verges/gaslevel"),
-      preferences.getString("mqttUser", ""),
-      preferences.getString("mqttPass", "")
-    );
+    const ConfigData &config = Config.get();
+    Mqtt.prepare(config.mqttHost, config.mqttPort, config.mqttTopic, config.mqttUser, config.mqttPass);
   }
   else LOG_INFO_LN(F("[MQTT] Publish to MQTT is disabled."));
 }
 
+// Publish a snapshot to all enabled outputs
+void publishStatus(const StatusSnapshot &status) {
+  String jsonOutput;
+  DynamicJsonDocument jsonDoc(1024);
+  JsonArray jsonArray = jsonDoc.to<JsonArray>();
+
+  for (uint8_t i=0; i < LEVELMANAGERS; i++) {
+    JsonObject jsonNestedObject = jsonArray.createNestedObject();
+
+    jsonNestedObject["id"] = i;
+    if (status.environment) {
+      jsonNestedObject["airPressure"] = status.pressure;
+      jsonNestedObject["temperature"] = status.temperature;
+    }
+    jsonNestedObject["sensorValue"] = status.scales[i].sensorValue;
+
+    if (status.environment && enableMqtt && Mqtt.isReady()) {
+      Mqtt.publish("/airPressure", String(status.pressure));
+      Mqtt.publish("/temperature", String(status.temperature));
+    }
+
+    if (status.scales[i].configured) {
+      jsonNestedObject["level"] = status.scales[i].level;
+      jsonNestedObject["gasWeight"] = status.scales[i].gasWeight;
+
+      if (enableDac) dacValue(i+1, status.scales[i].level);
+      if (enableBle) updateBleCharacteristic(i, status.scales[i].level, status.scales[i].gasWeight);
+      History.add(i, status.scales[i].level, status.scales[i].gasWeight);
+      if (enableMqtt && Mqtt.isReady()) {
+        Mqtt.publish("/level" + String(i+1), String(status.scales[i].level));
+        Mqtt.publish("/sensorValue" + String(i+1), String(status.scales[i].sensorValue));
+        Mqtt.publish("/gasWeight" + String(i+1), String(status.scales[i].gasWeight));
+      }
+      LOG_INFO_F("[SENSOR] %d. sensor level is %d%% (raw sensor value = %d)\n",
+        i+1, status.scales[i].level, status.scales[i].sensorValue
+      );
+    } else {
+      if (enableDac) dacValue(i+1, 0);
+      if (enableBle) updateBleCharacteristic(i, 0);
+      if (enableMqtt && Mqtt.isReady()) {
+        Mqtt.publish("/level" + String(i+1), "0");
+        Mqtt.publish("/sensorValue" + String(i+1), String(status.scales[i].sensorValue));
+        Mqtt.publish("/gasWeight" + String(i+1), "0");
+      }
+      LOG_INFO_F("[SENSOR] %d. Sensor is not configured, please run the setup! (raw sensor value %d)\n",
+        i+1, status.scales[i].sensorValue
+      );
+    }
+  }
+
+  if (enableBle) updateBleAdvertisement();
+
+  serializeJsonPretty(jsonArray, jsonOutput);
+  events.send(jsonOutput.c_str(), "status", millis());
+  //LOG_INFO_LN(jsonOutput);
+}
+
+/**
+ * @brief Background Task on the network core, publishes new snapshots and keeps the services alive.
+ * Slow network calls only delay this task, sampling continues in loop() on the other core.
+ */
+void outputTask(void* param) {
+  StatusSnapshot status;
+  uint32_t published = 0;
+  for(;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(Timing.serviceInterval));
+
+    // Do not continue regular operation as long as a OTA is running
+    if (otaWebUpdater.otaIsRunning) continue;
+
+    if (runtime() - Timing.lastServiceCheck > Timing.serviceInterval) {
+      Timing.lastServiceCheck = runtime();
+      // Check if all the services work
+      if (enableWifi && WiFi.status() == WL_CONNECTED && WiFi.getMode() & WIFI_MODE_STA) {
+        if (enableMqtt && !Mqtt.isConnected()) Mqtt.connect();
+      }
+    }
+
+    publishLatest(statusSnapshot, status, published, publishStatus);
+  }
+}
+
+bool startOutputTask() {
+  if (outputTaskHandle != NULL) return true;
+  BaseType_t xReturned = xTaskCreatePinnedToCore(
+    outputTask,
+    "Output",
+    8192,   // Stack size in words
+    NULL,   // Task input parameter
+    1,      // Priority of the task
+    &outputTaskHandle,  // Task handle.
+    OUTPUT_CORE
+  );
+  if (xReturned != pdPASS) {
+    LOG_ERROR_LN(F("[OUTPUT] Unable to run the background Task"));
+    return false;
+  }
+  return true;
+}
+
 void setup() {
 //  pinMode(23, OUTPUT);
 //  digitalWrite(23, LOW);
@@ -181,6 +356,9 @@ void setup() {
   LOG_INFO_F("Firmware build date: %s %s\n", __DATE__, __TIME__);
   LOG_INFO_F("Firmware Version: %s (%s)\n", AUTO_FW_VERSION, AUTO_FW_DATE);
 
+  loopTaskHandle = xTaskGetCurrentTaskHandle();
+  Energy.begin();
+  if (xPortGetCoreID() != SAMPLING_CORE) LOG_WARN_F("[SETUP] Sampling runs on core %d instead of %d\n", xPortGetCoreID(), SAMPLING_CORE);
   print_wakeup_reason();
   LOG_INFO_F("[SETUP] Configure ESP32 to sleep for every %d Seconds\n", TIME_TO_SLEEP);
 
@@ -189,65 +367,77 @@ void setup() {
   attachInterrupt(button1.PIN, ISR_button1, FALLING);
   LOG_INFO_LN(F("done"));
 
-  if (!LittleFS.begin(true)) {
-    LOG_INFO_LN(F("[FS] An Error has occurred while mounting LittleFS"));
-    // Reduce power consumption while having issues with NVS
-    // This won't fix the problem, a check of the sensor log is required
-    deepsleepForSeconds(5);
+  // Mounting (or formatting) LittleFS is independent of the sensors and NVS, run it on the other core
+  filesystemReady = xSemaphoreCreateBinary();
+  if (filesystemReady == NULL || xTaskCreatePinnedToCore(mountFilesystemTask, "BootFs", 4096, NULL, 1, NULL, OUTPUT_CORE) != pdPASS) {
+    mountFilesystem();
+    if (filesystemReady != NULL) xSemaphoreGive(filesystemReady);
   }
-  if (!preferences.begin(NVS_NAMESPACE)) preferences.clear();
-  LOG_INFO_LN(F("[LITTLEFS] initialized"));
 
-  bmp180_found = bmp180.begin(BMP085_MODE_ULTRAHIGHRES);
-  if (!bmp180_found) {
-    LOG_INFO_LN(F("[BMP180] Chip not found, trying BMP280 next"));
-    bmp280_found = bmp280.begin(BMP280_ADDRESS_ALT);
-    if (bmp280_found) {
-      /* Default settings from datasheet. */
-      bmp280.setSampling(Adafruit_BMP280::MODE_NORMAL,     /* Operating Mode. */
-                          Adafruit_BMP280::SAMPLING_X2,     /* Temp. oversampling */
-                          Adafruit_BMP280::SAMPLING_X16,    /* Pressure oversampling */
-                          Adafruit_BMP280::FILTER_X16,      /* Filtering. */
-                          Adafruit_BMP280::STANDBY_MS_500); /* Standby time. */
-      bmp280_temp->printSensorDetails();
-    } else {
-     LOG_INFO_LN(F("[BMP280] Chip not found, disabling temperature and pressure"));
-    }
+  {
+    BootStage stage("nvs");
+    if (!preferences.begin(NVS_NAMESPACE)) preferences.clear();
+    Config.load();
   }
 
-  for (uint8_t i=0; i < LEVELMANAGERS; i++) {
-    LevelManagers[i]->begin(String(NVS_NAMESPACE) + String("s") + String(i));
+  beginEnvironmentSensor();
+
+  {
+    BootStage stage("scales");
+    for (uint8_t i=0; i < LEVELMANAGERS; i++) {
+      LevelManagers[i]->begin(String(NVS_NAMESPACE) + String("s") + String(i));
+    }
   }
   
-  // Load Settings from NVS
-  hostname = preferences.getString("hostname");
-  if (hostname.isEmpty()) {
-    hostname = "gaslevel";
-    preferences.putString("hostname", hostname);
+  // Settings are read once from NVS by Config.load()
+  const ConfigData &config = Config.get();
+  hostname = config.hostname;
+  enableWifi = config.enableWifi;
+  enableBle = config.enableBle;
+  enableBleBroadcast = config.enableBleBroadcast;
+  enableDac = config.enableDac;
+  enableMqtt = config.enableMqtt;
+  enableOtaWebUpdate = config.otaWebEnabled;
+
+  if (!config.otaWebUrl.isEmpty()) {
+    otaWebUpdater.setBaseUrl(config.otaWebUrl);
   }
-  enableWifi = preferences.getBool("enableWifi", true);
-  enableBle = preferences.getBool("enableBle", false);
-  enableDac = preferences.getBool("enableDac", false);
-  enableMqtt = preferences.getBool("enableMqtt", false);
-  enableOtaWebUpdate = preferences.getBool("otaWebEnabled", enableOtaWebUpdate);
-
-  if (!preferences.getString("otaWebUrl").isEmpty()) {
-    otaWebUpdater.setBaseUrl(preferences.getString("otaWebUrl"));
+
+  // Everything below may access the filesystem
+  if (filesystemReady != NULL) {
+    BootStage stage("wait littlefs");
+    xSemaphoreTake(filesystemReady, portMAX_DELAY);
+  }
+  if (!filesystemMounted) {
+    LOG_ERROR_LN(F("[FS] An Error has occurred while mounting LittleFS"));
+#ifndef WEBUI_EMBEDDED
+    // Reduce power consumption while having issues with NVS
+    // This won't fix the problem, a check of the sensor log is required
+    deepsleepForSeconds(5);
+#endif
   }
 
-  if (enableWifi) initWifiAndServices();
+  if (enableWifi) {
+    BootStage stage("wifi");
+    initWifiAndServices();
+  }
   else LOG_INFO_LN(F("[WIFI] Not starting WiFi!"));
+  if (enableWifi || enableBle || enableMqtt) startOutputTask();
 
-  if (enableBle) createBleServer(hostname);
+  if (enableBle) {
+    BootStage stage("ble");
+    createBleServer(hostname, LEVELMANAGERS);
+  }
   else LOG_INFO_LN(F("[BLE] Bluetooth low energy is disabled."));
   
-  String otaPassword = preferences.getString("otaPassword");
-  if (otaPassword.isEmpty()) {
-    otaPassword = String((uint32_t)ESP.getEfuseMac());
-    preferences.putString("otaPassword", otaPassword);
+  if (Config.get().otaPassword.isEmpty()) {
+    ConfigData updated = Config.get();
+    updated.otaPassword = String((uint32_t)ESP.getEfuseMac());
+    String error;
+    if (!Config.commit(updated, error)) LOG_ERROR_F("[OTA] Unable to store the password: %s\n", error.c_str());
   }
-  otaWebUpdater.setOtaPassword(otaPassword);
-  LOG_INFO_F("[OTA] Password set to '%s'\n", otaPassword);
+  otaWebUpdater.setOtaPassword(Config.get().otaPassword);
+  LOG_INFO_F("[OTA] Password set to '%s'\n", Config.get().otaPassword.c_str());
   preferences.end();
 
   for (uint8_t i=0; i < LEVELMANAGERS; i++) {
@@ -256,6 +446,7 @@ void setup() {
       enableWifi = true;
     }
   }
+  Boot.finish();
 }
 
 // Soft reset the ESP to start with setup() again, but without loosing RTC_DATA as it would be with ESP.reset()
@@ -271,6 +462,9 @@ void softReset() {
 }
 
 void loop() {
+  int64_t loopStart = esp_timer_get_time();
+  Energy.setRadioState(WiFi.getMode() != WIFI_OFF, enableBle);
+
   if (button1.pressed) {
     LOG_INFO_LN(F("[EVENT] Button pressed!"));
     button1.pressed = false;
@@ -279,6 +473,7 @@ void loop() {
       WifiManager.runSoftAP();
     } else {
       initWifiAndServices();
+      startOutputTask();
     }
     // softReset();
   }
@@ -287,44 +482,34 @@ void loop() {
   // Reason: Background workload can cause upgrade issues that we want to avoid!
   if (otaWebUpdater.otaIsRunning) return sleepOrDelay();
 
-  if (runtime() - Timing.lastServiceCheck > Timing.serviceInterval) {
-    Timing.lastServiceCheck = runtime();
-    // Check if all the services work
-    if (enableWifi && WiFi.status() == WL_CONNECTED && WiFi.getMode() & WIFI_MODE_STA) {
-      if (enableMqtt && !Mqtt.isConnected()) Mqtt.connect();
-    }
-  }
-
-  // Update values from HX711
+  // Update values from HX711, recordings store the last temperature and pressure with each sample
+  EnvReading environment = EnvSensor.getReading();
+  if (!EnvSensor.isRecent(environment)) environment.temperature = environment.pressure = NAN;
   for (uint8_t i=0; i < LEVELMANAGERS; i++) {
     // LevelManagers[i]->initHX711();
+    LevelManagers[i]->setEnvironment(environment.temperature, environment.pressure);
     LevelManagers[i]->loop();
   }
 
-  // run regular operation
+  // Triggers the conversions of temperature and pressure and collects them once done
+  EnvSensor.loop();
+
+  // Take a snapshot of all values, publishing it is up to the output task
   if (runtime() - Timing.lastStatusUpdate > Timing.statusUpdateInterval) {
-    Timing.lastStatusUpdate = runtime();
-
-    String jsonOutput;
-    DynamicJsonDocument jsonDoc(1024);
-    JsonArray jsonArray = jsonDoc.to<JsonArray>();
-
-    float pressure = 0.f;
-    float temperature = 0.f;
-    if (bmp180_found) {
-      sensors_event_t event;
-      bmp180.getEvent(&event);
-      bmp180.getTemperature(&temperature);
-      pressure = event.pressure;
-
-    } else if (bmp280_found) {
-      sensors_event_t temp_event, pressure_event;
-      bmp280_pressure->getEvent(&pressure_event);
-      bmp280_temp->getEvent(&temp_event);
-      pressure = pressure_event.pressure;
-      temperature = temp_event.temperature;
-      
+    uint64_t now = runtime();
+    if (Timing.lastStatusUpdate) {
+      metricSampleDelay.observe(min(now - Timing.lastStatusUpdate - Timing.statusUpdateInterval, (uint64_t)UINT32_MAX / 1000) * 1000);
     }
+    Timing.lastStatusUpdate = now;
+
+    StatusSnapshot status;
+    // Without the output task, this is the only run before deep sleep and the
+    // measurement started in setup() has to be completed
+    if (outputTaskHandle == NULL) EnvSensor.completePending();
+    EnvReading env = EnvSensor.getReading();
+    status.environment = EnvSensor.isRecent(env);
+    status.pressure = env.pressure;
+    status.temperature = env.temperature;
 /*
     digitalWrite(23, LOW);
     sensors.begin();
@@ -336,50 +521,17 @@ void loop() {
     delay(100);
 */
     for (uint8_t i=0; i < LEVELMANAGERS; i++) {
-      JsonObject jsonNestedObject = jsonArray.createNestedObject();
-      // LevelManagers[i]->initHX711();
-
-      jsonNestedObject["id"] = i;
-      jsonNestedObject["airPressure"] = pressure;
-      jsonNestedObject["temperature"] = temperature;
-      jsonNestedObject["sensorValue"] = LevelManagers[i]->getLastMedian();
-
-      if (enableMqtt && Mqtt.isReady()) {
-        Mqtt.client.publish((Mqtt.mqttTopic + "/airPressure").c_str(), String(pressure).c_str(), true);
-        Mqtt.client.publish((Mqtt.mqttTopic + "/temperature").c_str(), String(temperature).c_str(), true);
-      }
-
-      if (LevelManagers[i]->isConfigured()) {
-        jsonNestedObject["level"] = LevelManagers[i]->getLevel();
-        jsonNestedObject["gasWeight"] = LevelManagers[i]->getGasWeight();
-
-        if (enableDac) dacValue(i+1, LevelManagers[i]->getLevel());
-        if (enableBle) updateBleCharacteristic(LevelManagers[i]->getLevel());  // FIXME: need to manage multiple levels
-        if (enableMqtt && Mqtt.isReady()) {
-          Mqtt.client.publish((Mqtt.mqttTopic + "/level" + String(i+1)).c_str(), String(LevelManagers[i]->getLevel()).c_str(), true);
-          Mqtt.client.publish((Mqtt.mqttTopic + "/sensorValue" + String(i+1)).c_str(), String(LevelManagers[i]->getLastMedian()).c_str(), true);
-          Mqtt.client.publish((Mqtt.mqttTopic + "/gasWeight" + String(i+1)).c_str(), String(LevelManagers[i]->getGasWeight()).c_str(), true);
-        }
-        LOG_INFO_F("[SENSOR] %d. sensor level is %d%% (raw sensor value = %d)\n",
-          i+1, LevelManagers[i]->getLevel(), LevelManagers[i]->getLastMedian()
-        );
-      } else {
-        if (enableDac) dacValue(i+1, 0);
-        if (enableBle) updateBleCharacteristic(0);  // FIXME
-        if (enableMqtt && Mqtt.isReady()) {
-          Mqtt.client.publish((Mqtt.mqttTopic + "/level" + String(i+1)).c_str(), "0", true);
-          Mqtt.client.publish((Mqtt.mqttTopic + "/sensorValue" + String(i+1)).c_str(), String(LevelManagers[i]->getLastMedian()).c_str(), true);
-          Mqtt.client.publish((Mqtt.mqttTopic + "/gasWeight" + String(i+1)).c_str(), "0", true);
-        }
-        LOG_INFO_F("[SENSOR] %d. Sensor is not configured, please run the setup! (raw sensor value %d)\n",
-          i+1, LevelManagers[i]->getLastMedian()
-        );
-      }
+      status.scales[i].configured = LevelManagers[i]->isConfigured();
+      status.scales[i].sensorValue = LevelManagers[i]->getLastMedian();
+      status.scales[i].level = LevelManagers[i]->getLevel();
+      status.scales[i].gasWeight = LevelManagers[i]->getGasWeight();
     }
+    statusSnapshot.write(status);
 
-    serializeJsonPretty(jsonArray, jsonOutput);
-    events.send(jsonOutput.c_str(), "status", millis());
-    //LOG_INFO_LN(jsonOutput);
+    if (outputTaskHandle != NULL) xTaskNotifyGive(outputTaskHandle);
+    else publishStatus(status);   // deep sleep mode, the output is required before going to sleep
   }
+  metricLoopDuration.observe(esp_timer_get_time() - loopStart);
+  LOG_FLUSH();
   sleepOrDelay();
 }
@@ -0,0 +1,86 @@
+/**
+ * @file metrics.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Lightweight counters, gauges and histograms in Prometheus text format
+ * @version 0.1
+ * @date 2023-02-05
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "metrics.h"
+
+static const uint32_t SENSOR_BUCKETS_US[METRIC_HISTOGRAM_BUCKETS] = { 50000, 100000, 150000, 200000, 300000, 500000, 1000000, 2000000 };
+static const uint32_t REQUEST_BUCKETS_US[METRIC_HISTOGRAM_BUCKETS] = { 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 };
+static const uint32_t LOOP_BUCKETS_US[METRIC_HISTOGRAM_BUCKETS] = { 100, 1000, 10000, 50000, 100000, 250000, 500000, 1000000 };
+
+MetricCounter metricScaleReads("gaslevel_scale_reads_total", "Successful HX711 median readings of all scales");
+MetricCounter metricScaleReadFailures("gaslevel_scale_read_failures_total", "Failed HX711 readings of all scales");
+MetricHistogram metricScaleReadDuration("gaslevel_scale_read_duration_seconds", "Time to read the HX711 median value", SENSOR_BUCKETS_US);
+
+MetricCounter metricMqttPublishes("gaslevel_mqtt_publishes_total", "Messages published to the MQTT broker");
+MetricCounter metricMqttPublishFailures("gaslevel_mqtt_publish_failures_total", "Messages that could not be published");
+MetricCounter metricMqttReconnects("gaslevel_mqtt_reconnects_total", "Connection attempts to the MQTT broker");
+
+MetricCounter metricWebSerialDropped("gaslevel_webserial_dropped_bytes_total", "Log output dropped because the WebSerial buffer was full");
+MetricCounter metricLogFileWrites("gaslevel_logfile_writes_total", "Pages written to the persistent log file");
+MetricCounter metricLogFileDropped("gaslevel_logfile_dropped_bytes_total", "Log output dropped because the log file page was full");
+
+MetricHistogram metricHttpRequestDuration("gaslevel_http_request_duration_seconds", "Execution time of the API request handlers", REQUEST_BUCKETS_US);
+MetricHistogram metricLoopDuration("gaslevel_loop_duration_seconds", "Execution time of one loop() iteration without sleep", LOOP_BUCKETS_US);
+MetricHistogram metricSampleDelay("gaslevel_sample_delay_seconds", "Delay of the sensor sampling behind its schedule", LOOP_BUCKETS_US);
+
+MetricGauge metricUptime("gaslevel_uptime_seconds", "Time since the last boot");
+MetricGauge metricFreeHeap("gaslevel_heap_free_bytes", "Currently free heap");
+MetricGauge metricMinFreeHeap("gaslevel_heap_min_free_bytes", "Lowest free heap since boot");
+MetricGauge metricLargestFreeBlock("gaslevel_heap_largest_free_block_bytes", "Largest allocatable block of the heap");
+
+Metric * Metric::first = nullptr;
+
+Metric::Metric(const char * name, const char * help, const char * type) : name(name), help(help), type(type) {
+  // Global constructors run before any task is started, no locking required
+  next = first;
+  first = this;
+}
+
+void Metric::renderAll(Print &out) {
+  for (Metric * m = first; m != nullptr; m = m->next) m->render(out);
+}
+
+void Metric::renderHeader(Print &out) {
+  out.printf("# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void MetricCounter::render(Print &out) {
+  renderHeader(out);
+  out.printf("%s %u\n", name, get());
+}
+
+void MetricGauge::render(Print &out) {
+  renderHeader(out);
+  out.printf("%s %.3f\n", name, get());
+}
+
+void MetricHistogram::observe(uint32_t us) {
+  uint8_t i = 0;
+  while (i < METRIC_HISTOGRAM_BUCKETS && us > bounds[i]) i++;
+  buckets[i].fetch_add(1, std::memory_order_relaxed);
+  sumUs.fetch_add(us, std::memory_order_relaxed);
+}
+
+void MetricHistogram::render(Print &out) {
+  renderHeader(out);
+  // Prometheus buckets are cumulative
+  uint32_t count = 0;
+  for (uint8_t i = 0; i < METRIC_HISTOGRAM_BUCKETS; i++) {
+    count += buckets[i].load(std::memory_order_relaxed);
+    out.printf("%s_bucket{le=\"%g\"} %u\n", name, bounds[i] / 1000000.0, count);
+  }
+  count += buckets[METRIC_HISTOGRAM_BUCKETS].load(std::memory_order_relaxed);
+  out.printf("%s_bucket{le=\"+Inf\"} %u\n", name, count);
+  out.printf("%s_sum %.6f\n", name, sumUs.load(std::memory_order_relaxed) / 1000000.0);
+  out.printf("%s_count %u\n", name, count);
+}
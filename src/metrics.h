@@ -0,0 +1,121 @@
+/**
+ * @file metrics.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Lightweight counters, gauges and histograms in Prometheus text format
+ * @version 0.1
+ * @date 2023-02-05
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef METRICS_h
+#define METRICS_h
+
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+
+class Metric {
+  public:
+    Metric(const char * name, const char * help, const char * type);
+
+    // Write the metric in Prometheus text exposition format
+    virtual void render(Print &out) = 0;
+
+    // Write all registered metrics
+    static void renderAll(Print &out);
+
+  protected:
+    const char * name;
+    const char * help;
+    const char * type;
+
+    void renderHeader(Print &out);
+
+  private:
+    // All metrics are registered in a static list on construction
+    Metric * next = nullptr;
+    static Metric * first;
+};
+
+class MetricCounter : public Metric {
+  public:
+    MetricCounter(const char * name, const char * help) : Metric(name, help, "counter") {}
+    void inc(uint32_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+    uint32_t get() { return value.load(std::memory_order_relaxed); }
+    void render(Print &out) override;
+
+  private:
+    std::atomic<uint32_t> value{0};
+};
+
+class MetricGauge : public Metric {
+  public:
+    MetricGauge(const char * name, const char * help) : Metric(name, help, "gauge") {}
+    void set(float v) { value.store(v, std::memory_order_relaxed); }
+    float get() { return value.load(std::memory_order_relaxed); }
+    void render(Print &out) override;
+
+  private:
+    std::atomic<float> value{0.f};
+};
+
+#define METRIC_HISTOGRAM_BUCKETS 8
+
+class MetricHistogram : public Metric {
+  public:
+    // Bucket upper bounds in microseconds, ascending
+    MetricHistogram(const char * name, const char * help, const uint32_t (&boundsUs)[METRIC_HISTOGRAM_BUCKETS])
+      : Metric(name, help, "histogram"), bounds(boundsUs) {}
+
+    // Record a duration in microseconds
+    void observe(uint32_t us);
+    void render(Print &out) override;
+
+  private:
+    const uint32_t (&bounds)[METRIC_HISTOGRAM_BUCKETS];
+    std::atomic<uint32_t> buckets[METRIC_HISTOGRAM_BUCKETS + 1] = {};  // last one is +Inf
+    std::atomic<uint64_t> sumUs{0};
+};
+
+// Measure the lifetime of the object into a histogram
+class MetricTimer {
+  public:
+    MetricTimer(MetricHistogram &h) : histogram(h), start(esp_timer_get_time()) {}
+    ~MetricTimer() { histogram.observe(esp_timer_get_time() - start); }
+
+  private:
+    MetricHistogram &histogram;
+    int64_t start;
+};
+
+// Sampling of the HX711 scales
+extern MetricCounter metricScaleReads;
+extern MetricCounter metricScaleReadFailures;
+extern MetricHistogram metricScaleReadDuration;
+
+// MQTT client
+extern MetricCounter metricMqttPublishes;
+extern MetricCounter metricMqttPublishFailures;
+extern MetricCounter metricMqttReconnects;
+
+// Log output
+extern MetricCounter metricWebSerialDropped;
+extern MetricCounter metricLogFileWrites;
+extern MetricCounter metricLogFileDropped;
+
+// Webserver and main loop
+extern MetricHistogram metricHttpRequestDuration;
+extern MetricHistogram metricLoopDuration;
+extern MetricHistogram metricSampleDelay;
+
+// System state, updated when rendered
+extern MetricGauge metricUptime;
+extern MetricGauge metricFreeHeap;
+extern MetricGauge metricMinFreeHeap;
+extern MetricGauge metricLargestFreeBlock;
+
+#endif // METRICS_h
@@ -0,0 +1,172 @@
+/**
+ * @file otaDelta.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Apply delta patches from tools/ota-delta-generator.py against the running firmware
+ * @version 0.1
+ * @date 2023-02-10
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "otaDelta.h"
+#include <esp_rom_crc.h>
+
+static uint32_t readU32(const uint8_t * p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaDelta::~OtaDelta() {
+  release();
+}
+
+bool OtaDelta::begin(const esp_partition_t * sourcePartition, Sink sink) {
+  release();
+  source = sourcePartition;
+  output = sink;
+  state = source ? HEADER : FAILED;
+  headerLen = 0;
+  sourcePos = 0;
+  targetPos = 0;
+  targetSize = 0;
+  windowLen = 0;
+  outLen = 0;
+
+  window = (uint8_t *) malloc(OTA_DELTA_BUFFER_SIZE);
+  outBuffer = (uint8_t *) malloc(OTA_DELTA_BUFFER_SIZE);
+  if (window == NULL || outBuffer == NULL) {
+    Serial.printf("[OTADELTA] Unable to request memory with malloc(%u)\n", OTA_DELTA_BUFFER_SIZE);
+    state = FAILED;
+  }
+  return state != FAILED;
+}
+
+void OtaDelta::release() {
+  free(window);
+  free(outBuffer);
+  window = NULL;
+  outBuffer = NULL;
+}
+
+bool OtaDelta::sourceMatches(uint32_t size, uint32_t crc) {
+  if (size > source->size) return false;
+  uint32_t sum = 0;
+  for (uint32_t pos = 0; pos < size; pos += OTA_DELTA_BUFFER_SIZE) {
+    uint32_t len = min((uint32_t)OTA_DELTA_BUFFER_SIZE, size - pos);
+    if (esp_partition_read(source, pos, window, len) != ESP_OK) return false;
+    sum = esp_rom_crc32_le(sum, window, len);
+  }
+  return sum == crc;
+}
+
+bool OtaDelta::parseHeader() {
+  if (memcmp(header, OTA_DELTA_MAGIC, 4) != 0 || header[4] != OTA_DELTA_VERSION) {
+    Serial.println(F("[OTADELTA] Invalid patch file"));
+    return false;
+  }
+  sourceSize = readU32(header + 8);
+  targetSize = readU32(header + 16);
+  if (!sourceMatches(sourceSize, readU32(header + 12))) {
+    Serial.println(F("[OTADELTA] Patch was not created for the running firmware"));
+    return false;
+  }
+  Serial.printf("[OTADELTA] Patching %u bytes of the running firmware to %u bytes\n", sourceSize, targetSize);
+  return true;
+}
+
+uint8_t OtaDelta::sourceByte(int64_t pos) {
+  // bsdiff treats everything outside the source as 0
+  if (pos < 0 || pos >= sourceSize) return 0;
+  if (pos < windowStart || pos >= windowStart + windowLen) {
+    windowStart = pos;
+    windowLen = min((uint32_t)OTA_DELTA_BUFFER_SIZE, sourceSize - windowStart);
+    if (esp_partition_read(source, windowStart, window, windowLen) != ESP_OK) {
+      windowLen = 0;
+      state = FAILED;
+      return 0;
+    }
+  }
+  return window[pos - windowStart];
+}
+
+bool OtaDelta::flushOutput() {
+  if (outLen == 0) return true;
+  if (!output(outBuffer, outLen)) return false;
+  outLen = 0;
+  return true;
+}
+
+bool OtaDelta::emit(uint8_t value) {
+  if (targetPos >= targetSize) return false;
+  outBuffer[outLen++] = value;
+  targetPos++;
+  return outLen < OTA_DELTA_BUFFER_SIZE || flushOutput();
+}
+
+void OtaDelta::nextState() {
+  if (diffRemaining) state = DIFF;
+  else if (extraRemaining) state = EXTRA;
+  else {
+    // record completed
+    sourcePos += seek;
+    state = RECORD;
+  }
+}
+
+bool OtaDelta::write(uint8_t * data, size_t len) {
+  while (len && state != FAILED) {
+    switch (state) {
+      case HEADER:
+      case RECORD: {
+        size_t wanted = (state == HEADER ? OTA_DELTA_HEADER_SIZE : OTA_DELTA_RECORD_SIZE) - headerLen;
+        size_t n = min(len, wanted);
+        memcpy(header + headerLen, data, n);
+        headerLen += n;
+        data += n;
+        len -= n;
+        if (n < wanted) break;
+
+        headerLen = 0;
+        if (state == HEADER) {
+          state = parseHeader() ? RECORD : FAILED;
+          break;
+        }
+        diffRemaining = readU32(header);
+        extraRemaining = readU32(header + 4);
+        seek = (int32_t)readU32(header + 8);
+        if ((uint64_t)targetPos + diffRemaining + extraRemaining > targetSize) state = FAILED;
+        else nextState();
+        break;
+      }
+      case DIFF:
+        for (; len && diffRemaining && state != FAILED; len--, diffRemaining--) {
+          if (!emit(*data++ + sourceByte(sourcePos++))) state = FAILED;
+        }
+        if (state != FAILED) nextState();
+        break;
+      case EXTRA: {
+        size_t n = min(len, (size_t)extraRemaining);
+        for (size_t i = 0; i < n && state != FAILED; i++) {
+          if (!emit(data[i])) state = FAILED;
+        }
+        data += n;
+        len -= n;
+        extraRemaining -= n;
+        if (state != FAILED) nextState();
+        break;
+      }
+      case FAILED:
+        break;
+    }
+  }
+  if (state == FAILED) Serial.printf("[OTADELTA] Failed to apply the patch at %u of %u bytes\n", targetPos, targetSize);
+  return state != FAILED;
+}
+
+bool OtaDelta::finish() {
+  bool complete = state == RECORD && headerLen == 0 && targetPos == targetSize && flushOutput();
+  state = FAILED;
+  release();
+  return complete;
+}
@@ -0,0 +1,79 @@
+/**
+ * @file otaDelta.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Apply delta patches from tools/ota-delta-generator.py against the running firmware
+ * @version 0.1
+ * @date 2023-02-10
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef OTADELTA_h
+#define OTADELTA_h
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <functional>
+
+#define OTA_DELTA_MAGIC "GLPD"
+#define OTA_DELTA_VERSION 1
+#define OTA_DELTA_HEADER_SIZE 20            // magic, version, source size, source crc32, target size
+#define OTA_DELTA_RECORD_SIZE 12            // diff length, extra length, seek
+#define OTA_DELTA_BUFFER_SIZE 4096          // Size of the source window and the output buffer
+
+class OtaDelta {
+  public:
+    // Receives the reconstructed firmware, returns false to abort
+    typedef std::function<bool(uint8_t * data, size_t len)> Sink;
+
+    virtual ~OtaDelta();
+
+    // Prepare to patch the given partition (usually esp_ota_get_running_partition())
+    bool begin(const esp_partition_t * source, Sink output);
+
+    // Consume the next part of the patch file
+    bool write(uint8_t * data, size_t len);
+
+    // Flush the remaining output, true if the complete firmware was created
+    bool finish();
+
+    // Size of the new firmware, known after the header was received
+    uint32_t getTargetSize() { return targetSize; }
+
+  private:
+    enum State { HEADER, RECORD, DIFF, EXTRA, FAILED };
+
+    const esp_partition_t * source = NULL;
+    Sink output;
+    State state = FAILED;
+
+    uint8_t header[OTA_DELTA_HEADER_SIZE];  // collects the header and the record fields
+    size_t headerLen = 0;
+
+    uint32_t sourceSize = 0;
+    uint32_t targetSize = 0;
+    int64_t sourcePos = 0;                  // may temporary point outside the source
+    uint32_t targetPos = 0;
+    uint32_t diffRemaining = 0;
+    uint32_t extraRemaining = 0;
+    int32_t seek = 0;
+
+    uint8_t * window = NULL;                // cached part of the source
+    uint32_t windowStart = 0;
+    uint32_t windowLen = 0;
+
+    uint8_t * outBuffer = NULL;
+    size_t outLen = 0;
+
+    bool parseHeader();
+    bool sourceMatches(uint32_t size, uint32_t crc);
+    uint8_t sourceByte(int64_t pos);
+    bool emit(uint8_t value);
+    void nextState();
+    bool flushOutput();
+    void release();
+};
+
+#endif // OTADELTA_h
@@ -0,0 +1,167 @@
+/**
+ * @file otaInflate.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Streaming decompression of gzip compressed firmware and filesystem images
+ * @version 0.1
+ * @date 2023-02-11
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "otaInflate.h"
+#include <esp_rom_crc.h>
+
+static uint32_t readU32(const uint8_t * p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+OtaInflate::~OtaInflate() {
+  release();
+}
+
+bool OtaInflate::begin(Sink sink) {
+  release();
+  output = sink;
+  state = HEADER;
+  headerLen = 0;
+  windowPos = 0;
+  crc = 0;
+  size = 0;
+
+  // The decompressor uses the ROM implementation of miniz, only the state is required in RAM
+  inflator = (tinfl_decompressor *) malloc(sizeof(tinfl_decompressor));
+  window = (uint8_t *) malloc(OTA_INFLATE_WINDOW_SIZE);
+  if (inflator == NULL || window == NULL) {
+    Serial.printf("[OTAINFLATE] Unable to request memory with malloc(%u)\n", sizeof(tinfl_decompressor) + OTA_INFLATE_WINDOW_SIZE);
+    state = FAILED;
+    release();
+    return false;
+  }
+  tinfl_init(inflator);
+  return true;
+}
+
+void OtaInflate::release() {
+  free(inflator);
+  free(window);
+  inflator = NULL;
+  window = NULL;
+}
+
+bool OtaInflate::collect(uint8_t *& data, size_t & len, size_t wanted) {
+  size_t n = min(len, wanted - headerLen);
+  memcpy(header + headerLen, data, n);
+  headerLen += n;
+  data += n;
+  len -= n;
+  if (headerLen < wanted) return false;
+  headerLen = 0;
+  return true;
+}
+
+void OtaInflate::nextHeaderState() {
+  // Optional fields are stored in this order
+  if (pendingFlags & OTA_GZIP_FEXTRA) state = EXTRA_LEN;
+  else if (pendingFlags & OTA_GZIP_FNAME) state = NAME;
+  else if (pendingFlags & OTA_GZIP_FCOMMENT) state = COMMENT;
+  else if (pendingFlags & OTA_GZIP_FHCRC) {
+    state = HCRC;
+    skip = 2;
+  }
+  else state = BODY;
+}
+
+bool OtaInflate::inflateBody(uint8_t *& data, size_t & len) {
+  tinfl_status status;
+  do {
+    size_t inBytes = len;
+    size_t outBytes = OTA_INFLATE_WINDOW_SIZE - windowPos;
+    status = tinfl_decompress(inflator, data, &inBytes, window, window + windowPos, &outBytes, TINFL_FLAG_HAS_MORE_INPUT);
+    data += inBytes;
+    len -= inBytes;
+
+    if (outBytes) {
+      crc = esp_rom_crc32_le(crc, window + windowPos, outBytes);
+      size += outBytes;
+      if (!output(window + windowPos, outBytes)) return false;
+      windowPos = (windowPos + outBytes) & (OTA_INFLATE_WINDOW_SIZE - 1);
+    }
+    if (status < TINFL_STATUS_DONE) {
+      Serial.printf("[OTAINFLATE] Invalid compressed data (%d)\n", status);
+      return false;
+    }
+  } while (status == TINFL_STATUS_HAS_MORE_OUTPUT || (status == TINFL_STATUS_NEEDS_MORE_INPUT && len));
+
+  if (status == TINFL_STATUS_DONE) state = TRAILER;
+  return true;
+}
+
+bool OtaInflate::write(uint8_t * data, size_t len) {
+  while (len && state != FAILED) {
+    switch (state) {
+      case HEADER:
+        if (!collect(data, len, 10)) break;
+        if (header[0] != 0x1f || header[1] != 0x8b || header[2] != 8) {
+          Serial.println(F("[OTAINFLATE] Not a gzip file"));
+          state = FAILED;
+          break;
+        }
+        pendingFlags = header[3];
+        nextHeaderState();
+        break;
+      case EXTRA_LEN:
+        if (!collect(data, len, 2)) break;
+        skip = header[0] | (header[1] << 8);
+        state = EXTRA;
+        break;
+      case EXTRA:
+      case HCRC: {
+        size_t n = min(len, skip);
+        data += n;
+        len -= n;
+        skip -= n;
+        if (skip) break;
+        pendingFlags &= state == EXTRA ? ~OTA_GZIP_FEXTRA : ~OTA_GZIP_FHCRC;
+        nextHeaderState();
+        break;
+      }
+      case NAME:
+      case COMMENT: {
+        // zero terminated strings
+        uint8_t * end = (uint8_t *) memchr(data, 0, len);
+        size_t n = end ? end - data + 1 : len;
+        data += n;
+        len -= n;
+        if (!end) break;
+        pendingFlags &= state == NAME ? ~OTA_GZIP_FNAME : ~OTA_GZIP_FCOMMENT;
+        nextHeaderState();
+        break;
+      }
+      case BODY:
+        if (!inflateBody(data, len)) state = FAILED;
+        break;
+      case TRAILER:
+        if (!collect(data, len, 8)) break;
+        if (readU32(header) != crc || readU32(header + 4) != size) {
+          Serial.println(F("[OTAINFLATE] Checksum mismatch of the decompressed data"));
+          state = FAILED;
+        } else state = DONE;
+        break;
+      case DONE:
+        len = 0;  // ignore padding after the file
+        break;
+      case FAILED:
+        break;
+    }
+  }
+  return state != FAILED;
+}
+
+bool OtaInflate::finish() {
+  bool complete = state == DONE;
+  state = FAILED;
+  release();
+  return complete;
+}
@@ -0,0 +1,72 @@
+/**
+ * @file otaInflate.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Streaming decompression of gzip compressed firmware and filesystem images
+ * @version 0.1
+ * @date 2023-02-11
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef OTAINFLATE_h
+#define OTAINFLATE_h
+
+#include <Arduino.h>
+#include <functional>
+#include <esp32/rom/miniz.h>
+
+// Deflate references up to 32KB of previous output, the output buffer doubles as this window
+#define OTA_INFLATE_WINDOW_SIZE TINFL_LZ_DICT_SIZE
+
+// gzip header flags
+#define OTA_GZIP_FHCRC    0x02
+#define OTA_GZIP_FEXTRA   0x04
+#define OTA_GZIP_FNAME    0x08
+#define OTA_GZIP_FCOMMENT 0x10
+
+class OtaInflate {
+  public:
+    // Receives the decompressed data, returns false to abort
+    typedef std::function<bool(uint8_t * data, size_t len)> Sink;
+
+    virtual ~OtaInflate();
+
+    // Allocate the window and the decompressor
+    bool begin(Sink output);
+
+    // Consume the next part of the compressed file
+    bool write(uint8_t * data, size_t len);
+
+    // True if the file was complete and the checksum matches
+    bool finish();
+
+    // Bytes of decompressed data
+    uint32_t getSize() { return size; }
+
+  private:
+    enum State { HEADER, EXTRA_LEN, EXTRA, NAME, COMMENT, HCRC, BODY, TRAILER, DONE, FAILED };
+
+    Sink output;
+    State state = FAILED;
+
+    uint8_t header[10];                     // collects the fixed header, extra length and trailer
+    size_t headerLen = 0;
+    uint8_t pendingFlags = 0;               // optional header fields not yet skipped
+    size_t skip = 0;
+
+    tinfl_decompressor * inflator = NULL;
+    uint8_t * window = NULL;
+    size_t windowPos = 0;
+
+    uint32_t crc = 0;
+    uint32_t size = 0;
+
+    bool collect(uint8_t *& data, size_t & len, size_t wanted);
+    void nextHeaderState();
+    bool inflateBody(uint8_t *& data, size_t & len);
+    void release();
+};
+
+#endif // OTAINFLATE_h
@@ -0,0 +1,132 @@
+/**
+ * @file otaPipeline.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Double buffered hand over of downloaded data to a flash writer task
+ * @version 0.1
+ * @date 2023-02-09
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "otaPipeline.h"
+
+OtaPipeline::~OtaPipeline() {
+  finish();
+}
+
+bool OtaPipeline::begin(Sink newSink, size_t newBufferSize) {
+  sink = newSink;
+  bufferSize = newBufferSize;
+  failed = false;
+  written = 0;
+  current = NULL;
+
+  freeQueue = xQueueCreate(OTA_PIPELINE_BUFFERS, sizeof(uint8_t *));
+  filledQueue = xQueueCreate(OTA_PIPELINE_BUFFERS + 1, sizeof(Chunk));
+  done = xSemaphoreCreateBinary();
+  if (freeQueue == NULL || filledQueue == NULL || done == NULL) {
+    release();
+    return false;
+  }
+
+  for (uint8_t i = 0; i < OTA_PIPELINE_BUFFERS; i++) {
+    buffers[i] = (uint8_t *) malloc(bufferSize);
+    if (buffers[i] == NULL) {
+      Serial.printf("[OTAPIPELINE] Unable to request memory with malloc(%u)\n", bufferSize);
+      release();
+      return false;
+    }
+    xQueueSend(freeQueue, &buffers[i], 0);
+  }
+
+  // Same priority as the reader, the network stack runs while the writer waits for the flash
+  BaseType_t xReturned = xTaskCreatePinnedToCore(
+    otaWriterTask,
+    "OtaWriter",
+    4096,   // Stack size in words
+    this,   // Task input parameter
+    uxTaskPriorityGet(NULL),  // Priority of the task
+    &writerTask,  // Task handle.
+    1       // Core where the task should run
+  );
+  if (xReturned != pdPASS) {
+    Serial.println(F("[OTAPIPELINE] Unable to run the writer Task"));
+    writerTask = NULL;
+    release();
+    return false;
+  }
+  return true;
+}
+
+uint8_t * OtaPipeline::acquire() {
+  if (writerTask == NULL) return NULL;
+  while (!failed) {
+    if (xQueueReceive(freeQueue, &current, 100 / portTICK_PERIOD_MS) == pdTRUE) return current;
+  }
+  return NULL;
+}
+
+void OtaPipeline::commit(size_t len) {
+  if (current == NULL) return;
+  if (len == 0) {
+    // nothing to write, directly reuse the buffer
+    xQueueSend(freeQueue, &current, 0);
+  } else {
+    Chunk chunk = { current, len };
+    xQueueSend(filledQueue, &chunk, portMAX_DELAY);
+  }
+  current = NULL;
+}
+
+bool OtaPipeline::finish() {
+  if (writerTask != NULL) {
+    if (current != NULL) commit(0);
+    Chunk end = { NULL, 0 };
+    xQueueSend(filledQueue, &end, portMAX_DELAY);
+    xSemaphoreTake(done, portMAX_DELAY);
+    writerTask = NULL;
+  }
+  release();
+  return !failed;
+}
+
+void OtaPipeline::release() {
+  for (uint8_t i = 0; i < OTA_PIPELINE_BUFFERS; i++) {
+    free(buffers[i]);
+    buffers[i] = NULL;
+  }
+  if (freeQueue != NULL) vQueueDelete(freeQueue);
+  if (filledQueue != NULL) vQueueDelete(filledQueue);
+  if (done != NULL) vSemaphoreDelete(done);
+  freeQueue = NULL;
+  filledQueue = NULL;
+  done = NULL;
+}
+
+void OtaPipeline::runWriter() {
+  Chunk chunk;
+  for(;;) {
+    xQueueReceive(filledQueue, &chunk, portMAX_DELAY);
+    if (chunk.len == 0) break;
+
+    // after a failure, the remaining data is only drained to unblock the reader
+    if (!failed) {
+      if (sink(chunk.data, chunk.len)) written += chunk.len;
+      else failed = true;
+    }
+    xQueueSend(freeQueue, &chunk.data, 0);
+  }
+  xSemaphoreGive(done);
+}
+
+/**
+ * @brief Writer Task, consumes the filled buffers until the pipeline is finished
+ * @param param needs to be a valid OtaPipeline instance
+ */
+void otaWriterTask(void* param) {
+  OtaPipeline * pipeline = (OtaPipeline *) param;
+  pipeline->runWriter();
+  vTaskDelete(NULL);
+}
@@ -0,0 +1,78 @@
+/**
+ * @file otaPipeline.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Double buffered hand over of downloaded data to a flash writer task
+ * @version 0.1
+ * @date 2023-02-09
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef OTAPIPELINE_h
+#define OTAPIPELINE_h
+
+#include <Arduino.h>
+#include <functional>
+
+#define OTA_PIPELINE_BUFFERS 2              // Buffers in flight between reader and writer
+#define OTA_PIPELINE_BUFFER_SIZE (16*1024)  // Size of each buffer, multiple of the flash sector size
+
+void otaWriterTask(void* param);
+
+class OtaPipeline {
+  public:
+    // Consumes one buffer of data, returns false to abort the pipeline
+    typedef std::function<bool(uint8_t * data, size_t len)> Sink;
+
+    virtual ~OtaPipeline();
+
+    // Allocate the buffers and start the writer task
+    bool begin(Sink sink, size_t bufferSize = OTA_PIPELINE_BUFFER_SIZE);
+
+    // Get an empty buffer of bufferSize bytes to fill, blocks while the writer is busy.
+    // Returns NULL if the writer failed.
+    uint8_t * acquire();
+
+    // Hand the buffer from acquire() with len bytes of data over to the writer
+    void commit(size_t len);
+
+    // Wait until all data has been written and stop the writer, true if everything was written
+    bool finish();
+
+    // Size of the buffers returned from acquire()
+    size_t getBufferSize() { return bufferSize; }
+
+    // Started and no write failed so far
+    bool isWriting() { return writerTask != NULL && !failed; }
+
+    // Bytes successfully consumed by the sink
+    size_t getWritten() { return written; }
+
+    // Executed by the writer task
+    void runWriter();
+
+  private:
+    struct Chunk {
+      uint8_t * data;
+      size_t len;                           // len 0 ends the writer
+    };
+
+    Sink sink;
+    size_t bufferSize = 0;
+    uint8_t * buffers[OTA_PIPELINE_BUFFERS] = {};
+    uint8_t * current = NULL;
+
+    QueueHandle_t freeQueue = NULL;         // empty buffers, filled by the writer
+    QueueHandle_t filledQueue = NULL;       // data to write, filled by the reader
+    SemaphoreHandle_t done = NULL;          // given when the writer has ended
+    TaskHandle_t writerTask = NULL;
+
+    volatile bool failed = false;
+    volatile size_t written = 0;
+
+    void release();
+};
+
+#endif // OTAPIPELINE_h
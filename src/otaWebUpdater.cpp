@@ -11,8 +11,18 @@
 #include <AsyncJson.h>
 #include <WiFi.h>
 #include <HTTPClient.h>
+#include <Preferences.h>
 #include <Update.h>
-#include <new>          // ::operator new[]
+#include <esp_ota_ops.h>
+#include "otaDelta.h"
+#include "otaInflate.h"
+#include <mbedtls/sha256.h>
+#include <mbedtls/pk.h>
+
+#if __has_include("otaPublicKey.h")
+  // Defines OTA_PUBLIC_KEY, created by tools/ota-manifest-generator.py
+  #include "otaPublicKey.h"
+#endif
 
 /**
  * @brief Construct a new OtaWebUpdater::OtaWebUpdater object
@@ -77,9 +87,21 @@ void OtaWebUpdater::attachWebServer(AsyncWebServer * srv) {
         request->send(500, "application/json", "{\"message\":\"Unable to begin firmware update!\"}");
         otaIsRunning = false;
       }
+
+      // compressed files are decompressed while receiving them
+      delete uploadInflate;
+      uploadInflate = NULL;
+      if (filename.endsWith(".gz")) {
+        uploadInflate = new OtaInflate();
+        if (!uploadInflate->begin([](uint8_t * data, size_t len) { return Update.write(data, len) == len; })) {
+          request->send(500, "application/json", "{\"message\":\"Unable to allocate memory for decompression!\"}");
+          otaIsRunning = false;
+        }
+      }
     }
 
-    if (Update.write(data, len) != len) {
+    bool written = uploadInflate ? uploadInflate->write(data, len) : Update.write(data, len) == len;
+    if (!written) {
       Serial.print(F("[OTA] Error: "));
       Update.printError(Serial);
       request->send(500, "application/json", "{\"message\":\"Unable to write firmware update data!\"}");
@@ -87,7 +109,14 @@ void OtaWebUpdater::attachWebServer(AsyncWebServer * srv) {
     }
 
     if (final) {
-      if (!Update.end(true)) {
+      bool complete = true;
+      if (uploadInflate) {
+        complete = uploadInflate->finish();
+        delete uploadInflate;
+        uploadInflate = NULL;
+      }
+      if (!complete) Update.abort();
+      if (!complete || !Update.end(true)) {
         String output;
         DynamicJsonDocument doc(32);
         doc["message"] = "Update error";
@@ -168,10 +197,15 @@ void OtaWebUpdater::loop() {
   if (newReleaseAvailable) executeUpdate();
 
   if (networkReady) {
-    if (initialCheck) {
-      if (millis() - lastVersionCheckMillis < intervalVersionCheckMillis) return;
-      lastVersionCheckMillis = millis();
-    } else initialCheck = true;
+    // Random offsets, so sensors powered up together don't check at the same time
+    if (!checkScheduled) {
+      nextVersionCheckMillis = millis() + esp_random() % OTA_INITIAL_JITTER_MS;
+      checkScheduled = true;
+    }
+    if ((int32_t)(millis() - nextVersionCheckMillis) < 0) return;
+
+    uint32_t jitter = intervalVersionCheckMillis * OTA_CHECK_JITTER_PERCENT / 100;
+    nextVersionCheckMillis = millis() + intervalVersionCheckMillis - jitter + esp_random() % (2 * jitter + 1);
 
     Serial.println(F("[OTAWEBUPDATER] Searching a new firmware release"));
     checkAvailableVersion();
@@ -186,19 +220,59 @@ void OtaWebUpdater::loop() {
 bool OtaWebUpdater::checkAvailableVersion() {
   WiFiClient client;
   HTTPClient http;
-  
+  Preferences validators;
+  validators.begin(OTA_NVS_NAMESPACE);
+
   // Send request
   http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
   http.useHTTP10(true);
   http.begin(client, baseUrl + "/current-version.json");
-  http.GET();
-
-  // Parse response
-  DynamicJsonDocument doc(2048);
-  deserializeJson(doc, http.getStream());
+  const char * headerKeys[] = { "ETag", "Last-Modified" };
+  http.collectHeaders(headerKeys, 2);
+
+  // Stored validators belong to a manifest this firmware has already processed
+  if (validators.getString("fwDate") == currentFwDate && validators.getString("url") == baseUrl) {
+    String etag = validators.getString("etag");
+    String lastModified = validators.getString("lastModified");
+    if (etag.length()) http.addHeader("If-None-Match", etag);
+    if (lastModified.length()) http.addHeader("If-Modified-Since", lastModified);
+  }
+  int httpCode = http.GET();
 
-  // Disconnect
+  if (httpCode == 304) {
+    http.end();
+    Serial.println(F("[OTAWEBUPDATER] No newer firmware available (not modified)"));
+    return true;
+  }
+  if (httpCode != 200 || http.getSize() > OTA_MANIFEST_MAX_SIZE) {
+    http.end();
+    Serial.printf("[OTAWEBUPDATER] Unable to load %s/current-version.json (HTTP %d)\n", baseUrl.c_str(), httpCode);
+    return false;
+  }
+  String etag = http.header("ETag");
+  String lastModified = http.header("Last-Modified");
+
+  // Only keep what is required
+  StaticJsonDocument<128> filter;
+  filter["date"] = true;
+  filter["revision"] = true;
+  filter["files"]["firmware.bin"] = true;
+  filter["files"]["littlefs.bin"] = true;
+  StaticJsonDocument<OTA_MANIFEST_DOC_SIZE> doc;
+
+#ifdef OTA_PUBLIC_KEY
+  // The raw content is required to verify the signature
+  String manifest = http.getString();
+  http.end();
+  if (!verifyManifest(manifest)) {
+    Serial.printf("[OTAWEBUPDATER] Invalid signature of %s/current-version.json\n", baseUrl.c_str());
+    return false;
+  }
+  deserializeJson(doc, manifest, DeserializationOption::Filter(filter));
+#else
+  deserializeJson(doc, http.getStream(), DeserializationOption::Filter(filter));
   http.end();
+#endif
 
   auto date = doc["date"].as<String>();
   auto revision = doc["revision"].as<String>();
@@ -207,17 +281,128 @@ bool OtaWebUpdater::checkAvailableVersion() {
     Serial.printf("[OTAWEBUPDATER] Invalid response or json in %s/current-version.json\n", baseUrl.c_str());
     return false;
   }
+
+  parseImage(doc["files"]["firmware.bin"].as<JsonObjectConst>(), firmwareImage);
+  parseImage(doc["files"]["littlefs.bin"].as<JsonObjectConst>(), filesystemImage);
+#ifdef OTA_PUBLIC_KEY
+  if (!firmwareImage.known || !filesystemImage.known) {
+    Serial.println(F("[OTAWEBUPDATER] Manifest without image digests, refusing the update"));
+    return false;
+  }
+#endif
+
   if (date > currentFwDate) { // a newer Version is available!
     Serial.printf("[OTAWEBUPDATER] Newer firmware available: %s vs %s\n", date.c_str(), currentFwDate.c_str());
     newReleaseAvailable = true;
+    // a 304 must not hide this release if the update fails
+    validators.clear();
+  } else {
+    Serial.println(F("[OTAWEBUPDATER] No newer firmware available"));
+    validators.putString("etag", etag);
+    validators.putString("lastModified", lastModified);
+    validators.putString("fwDate", currentFwDate);
+    validators.putString("url", baseUrl);
+  }
+  return true;
+}
+
+/**
+ * @brief Read size and SHA-256 digest of an image from the manifest
+ *
+ * @param json Entry of the image in "files"
+ * @param image Destination, image.known is false if the entry is missing or invalid
+ */
+void OtaWebUpdater::parseImage(JsonObjectConst json, OtaWebImage &image) {
+  image.known = false;
+  const char * hex = json["sha256"];
+  if (hex == nullptr || strlen(hex) != 2 * sizeof(image.sha256) || !json["size"].is<uint32_t>()) return;
+
+  for (size_t i = 0; i < sizeof(image.sha256); i++) {
+    char byte[3] = { hex[2*i], hex[2*i+1], 0 };
+    char * end;
+    image.sha256[i] = strtoul(byte, &end, 16);
+    if (*end != 0) return;
+  }
+  image.size = json["size"];
+  image.known = true;
+}
+
+/**
+ * @brief Verify current-version.json.sig against the manifest
+ * @details Only done if the firmware was built with a OTA_PUBLIC_KEY (see tools/ota-manifest-generator.py)
+ *
+ * @param manifest Raw content of current-version.json
+ * @return true if the signature is valid or no key is configured
+ */
+bool OtaWebUpdater::verifyManifest(const String &manifest) {
+#ifndef OTA_PUBLIC_KEY
+  return true;
+#else
+  if (manifest.isEmpty()) return false;
+
+  WiFiClient client;
+  HTTPClient http;
+  http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
+  http.useHTTP10(true);
+  http.begin(client, baseUrl + "/current-version.json.sig");
+
+  uint8_t signature[OTA_SIGNATURE_MAX_SIZE];
+  size_t signatureLen = 0;
+  if (http.GET() == 200 && http.getSize() > 0 && http.getSize() <= (int)sizeof(signature)) {
+    signatureLen = http.getStreamPtr()->readBytes(signature, http.getSize());
+  }
+  http.end();
+  if (signatureLen == 0) return false;
+
+  uint8_t hash[32];
+  mbedtls_sha256_ret((const unsigned char *)manifest.c_str(), manifest.length(), hash, 0);
+
+  mbedtls_pk_context key;
+  mbedtls_pk_init(&key);
+  bool valid = mbedtls_pk_parse_public_key(&key, (const unsigned char *)OTA_PUBLIC_KEY, sizeof(OTA_PUBLIC_KEY)) == 0
+    && mbedtls_pk_verify(&key, MBEDTLS_MD_SHA256, hash, sizeof(hash), signature, signatureLen) == 0;
+  mbedtls_pk_free(&key);
+  return valid;
+#endif
+}
+
+/**
+ * @brief Receive the body of a request into the pipeline
+ *
+ * @param stream The response body
+ * @param pipeline Started pipeline to fill
+ * @param received Bytes received so far, updated while reading
+ * @param totalLength Expected size of the whole file, -1 if unknown
+ * @return true if the file is complete
+ * @return false on a timeout, connection loss or writer failure
+ */
+bool OtaWebUpdater::receiveFile(WiFiClient * stream, OtaPipeline &pipeline, size_t &received, int totalLength) {
+  stream->setTimeout(OTA_READ_TIMEOUT_MS);
+
+  uint8_t lastProgress = totalLength > 0 ? received * 10 / totalLength : 0;
+  while (totalLength < 0 || received < (size_t)totalLength) {
+    uint8_t * buffer = pipeline.acquire();
+    if (buffer == NULL) return false;  // writer failed
+
+    size_t wanted = pipeline.getBufferSize();
+    if (totalLength > 0) wanted = min(wanted, (size_t)totalLength - received);
+    size_t readBufLen = stream->readBytes(buffer, wanted);
+    pipeline.commit(readBufLen);
+    received += readBufLen;
+    if (readBufLen < wanted) return totalLength < 0 && received > 0;  // end of a stream without length
+
+    if (totalLength > 0 && received * 10 / totalLength != lastProgress) {
+      lastProgress = received * 10 / totalLength;
+      Serial.printf("[OTAWEBUPDATER] Status: %u%%\n", lastProgress * 10);
+    }
   }
-  Serial.println(F("[OTAWEBUPDATER] No newer firmware available"));
   return true;
 }
 
 /**
  * @brief Download a file from a url and execute the firmware update
- * 
+ * @details An interrupted download is resumed with a Range request, up to OTA_RESUME_RETRIES times
+ *
  * @param baseUrl HTTPS url to download from
  * @param filename  The filename to download
  * @return true 
@@ -226,73 +411,137 @@ bool OtaWebUpdater::checkAvailableVersion() {
 bool OtaWebUpdater::updateFile(String baseUrl, String filename) {
   otaIsRunning = true;
   int filetype = (filename.indexOf("spiffs") > -1 || filename.indexOf("littlefs") > -1) ? U_SPIFFS : U_FLASH;
+  bool isCompressed = filename.endsWith(".gz");
+  bool isPatch = filetype == U_FLASH && (filename.endsWith(".patch") || filename.endsWith(".patch.gz"));
 
   String firmwareUrl = baseUrl + "/" + filename;
   WiFiClient client;
   HTTPClient http;
-  
-  // Reserve some memory to download the file
-  auto bufferAllocationLen = 128*1024;
-  uint8_t * buffer;
-  try {
-    buffer = new uint8_t[bufferAllocationLen];
-  } catch (std::bad_alloc& ba) {
-    Serial.printf("[OTAWEBUPDATER] Unable to request memory with malloc(%u)\n", bufferAllocationLen+1);
+  http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
+
+  Serial.printf("[OTAWEBUPDATER] Firmware type: %s%s%s\n", filetype == U_SPIFFS ? "spiffs" : "flash",
+    isPatch ? " patch" : "", isCompressed ? " (gzip)" : "");
+  Serial.printf("[OTAWEBUPDATER] Firmware url:  %s\n", firmwareUrl.c_str());
+
+  // Expected content from the manifest, independent of compression or patches
+  OtaWebImage &expected = filetype == U_SPIFFS ? filesystemImage : firmwareImage;
+#ifdef OTA_PUBLIC_KEY
+  if (!expected.known) {
     otaIsRunning = false;
     return false;
   }
-  
-  http.setFollowRedirects(HTTPC_FORCE_FOLLOW_REDIRECTS);
-  http.begin(client, firmwareUrl);
+#endif
+
+  // Download -> (decompress) -> (apply patch to the running firmware) -> hash + flash
+  OtaDelta delta;
+  OtaInflate inflate;
+  mbedtls_sha256_context sha;
+  mbedtls_sha256_init(&sha);
+  mbedtls_sha256_starts_ret(&sha, 0);
+  size_t imageSize = 0;
+  OtaPipeline::Sink flashWriter = [&sha, &imageSize](uint8_t * data, size_t len) {
+    mbedtls_sha256_update_ret(&sha, data, len);
+    imageSize += len;
+    return Update.write(data, len) == len;
+  };
+  OtaPipeline::Sink patchWriter = [&delta](uint8_t * data, size_t len) { return delta.write(data, len); };
+  OtaPipeline::Sink imageWriter = isPatch ? patchWriter : flashWriter;
+  OtaPipeline::Sink inflateWriter = [&inflate](uint8_t * data, size_t len) { return inflate.write(data, len); };
+
+  // The flash is written by a separate task, while this one receives the next buffer
+  OtaPipeline pipeline;
+  int totalLength = -1;       // size of the file, -1 when Server sends no Content-Length header
+  size_t received = 0;        // bytes handed to the pipeline, a resume continues from here
+  bool started = false;
+  bool complete = false;
+
+  for (uint8_t attempt = 0; attempt <= OTA_RESUME_RETRIES && !complete; attempt++) {
+    if (attempt) {
+      // A file without length can't be resumed, a failed writer won't recover
+      if (started && (totalLength < 0 || !pipeline.isWriting())) break;
+      Serial.printf("[OTAWEBUPDATER] Resuming download at %u of %d bytes (retry %u)\n", received, totalLength, attempt);
+      vTaskDelay(attempt * OTA_RESUME_DELAY_MS / portTICK_PERIOD_MS);
+    }
 
-  Serial.printf("[OTAWEBUPDATER] Firmware type: %s\n", filetype == U_SPIFFS ? "spiffs" : "flash");
-  Serial.printf("[OTAWEBUPDATER] Firmware url:  %s\n", firmwareUrl.c_str());
+    http.begin(client, firmwareUrl);
+    if (received) http.addHeader("Range", "bytes=" + String(received) + "-");
+    int httpCode = http.GET();
 
-  if (http.GET() == 200) {
-    // get length of document (is -1 when Server sends no Content-Length header)
-    auto totalLength = http.getSize();
-    auto len = totalLength;
-    auto currentLength = 0;
-
-    // this is required to start firmware update process
-    Update.begin(UPDATE_SIZE_UNKNOWN, filetype);
-    Serial.printf("[OTAWEBUPDATER] Firmware size: %u\n", totalLength);
-
-    // create buffer for read
-    //uint8_t buff[4096] = { 0 };
-    WiFiClient * stream = http.getStreamPtr();
-
-    // read all data from server
-    Serial.println("[OTAWEBUPDATER] Begin firmware upgrade...");
-    while(http.connected() && (len > 0 || len == -1)) {
-      // get available data size
-      size_t size = stream->available();
-      if(size) {
-        // read up to 4096 byte
-        int readBufLen = stream->readBytes(buffer, ((size > bufferAllocationLen) ? bufferAllocationLen : size));
-        if(len > 0) len -= readBufLen;
-
-        Update.write(buffer, readBufLen);
-        Serial.printf("[OTAWEBUPDATER] Status: %u\n", currentLength);
-
-        currentLength += readBufLen;
-        if(currentLength != totalLength) continue;
-        // Update completed
-        Update.end(true);
-        http.end();
-        Serial.println();
-        Serial.printf("[OTAWEBUPDATER] Upgrade successfully executed. Wrote bytes: %u\n", currentLength);
+    if (!started && httpCode == 200) {
+      totalLength = http.getSize();
+      Serial.printf("[OTAWEBUPDATER] Firmware size: %d\n", totalLength);
 
-        otaIsRunning = false;
-        delete[] buffer;
-        return true;
+      // this is required to start firmware update process
+      size_t imageLength = UPDATE_SIZE_UNKNOWN;
+      if (expected.known) imageLength = expected.size;
+      else if (totalLength > 0 && !isPatch && !isCompressed) imageLength = totalLength;
+      if (!Update.begin(imageLength, filetype)) {
+        Update.printError(Serial);
+        http.end();
+        break;
+      }
+      if ((isPatch && !delta.begin(esp_ota_get_running_partition(), flashWriter))
+        || (isCompressed && !inflate.begin(imageWriter))
+        || !pipeline.begin(isCompressed ? inflateWriter : imageWriter)
+      ) {
+        Update.abort();
+        http.end();
+        break;
+      }
+      started = true;
+    } else if (started && httpCode == (received ? 206 : 200)) {
+      if (received + http.getSize() != (size_t)totalLength) {
+        Serial.println(F("[OTAWEBUPDATER] File changed on the server, unable to resume"));
+        http.end();
+        break;
       }
-      delay(1);
+    } else {
+      // Network errors are retried, HTTP errors or servers without Range support are not
+      http.end();
+      if (httpCode > 0) break;
+      continue;
     }
+
+    complete = receiveFile(http.getStreamPtr(), pipeline, received, totalLength);
+    http.end();
   }
 
+  bool written = pipeline.finish();
+  if (isCompressed) written = inflate.finish() && written;
+  if (isPatch) written = delta.finish() && written;
+
+  // Must be rejected before Update.end() switches the boot partition
+  uint8_t digest[32];
+  mbedtls_sha256_finish_ret(&sha, digest);
+  mbedtls_sha256_free(&sha);
+  if (written && expected.known && (imageSize != expected.size || memcmp(digest, expected.sha256, sizeof(digest)) != 0)) {
+    Serial.println(F("[OTAWEBUPDATER] SHA-256 of the image does not match the manifest"));
+    written = false;
+  }
+  if (!complete || !written || !Update.end(true)) {
+    if (Update.isRunning()) Update.abort();
+    Update.printError(Serial);
+    Serial.printf("[OTAWEBUPDATER] Upgrade failed after %u of %d bytes\n", received, totalLength);
+    otaIsRunning = false;
+    return false;
+  }
+  Serial.printf("[OTAWEBUPDATER] Upgrade successfully executed. Received bytes: %u\n", pipeline.getWritten());
+
   otaIsRunning = false;
-  delete[] buffer;
+  return true;
+}
+
+/**
+ * @brief Install the first of the given files that is available on the server
+ *
+ * @param baseUrl HTTPS url to download from
+ * @param filenames Alternatives of the same content, in order of preference
+ * @return true if one of the files was installed
+ */
+bool OtaWebUpdater::updateAny(String baseUrl, std::initializer_list<String> filenames) {
+  for (auto &filename : filenames) {
+    if (updateFile(baseUrl, filename)) return true;
+  }
   return false;
 }
 
@@ -301,9 +550,14 @@ bool OtaWebUpdater::updateFile(String baseUrl, String filename) {
  */
 void OtaWebUpdater::executeUpdate() {
   otaIsRunning = true;
-  if (updateFile(baseUrl, "littlefs.bin") && updateFile(baseUrl, "firmware.bin") ) {
+  // Prefer a small patch against the running firmware and compressed images, if the release provides them
+  if (updateAny(baseUrl, {"littlefs.bin.gz", "littlefs.bin"})
+    && updateAny(baseUrl, {"firmware-" + currentFwRelease + ".patch.gz", "firmware.bin.gz", "firmware.bin"})
+  ) {
     ESP.restart();
   } else {
+    // try again with the next version check, not in an endless loop
+    newReleaseAvailable = false;
     otaIsRunning = false;
     Serial.println("[OTAWEBUPDATER] Failed to update firmware");
   }
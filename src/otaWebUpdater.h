@@ -14,12 +14,34 @@
 
 #include <Arduino.h>
 #include <ESPAsyncWebServer.h>
+#include <ArduinoJson.h>
+#include <WiFiClient.h>
+#include "otaPipeline.h"
+#include "otaInflate.h"
+#include <initializer_list>
+
+#define OTA_READ_TIMEOUT_MS 5000            // Abort a download if no data is received within this time
+#define OTA_RESUME_RETRIES 5                // Resume an interrupted download this often
+#define OTA_RESUME_DELAY_MS 2000            // Wait before resuming, multiplied by the attempt
+#define OTA_MANIFEST_MAX_SIZE 2048          // Max size of current-version.json
+#define OTA_SIGNATURE_MAX_SIZE 512          // Max size of current-version.json.sig
+#define OTA_MANIFEST_DOC_SIZE 512           // JsonDocument for the filtered manifest
+#define OTA_NVS_NAMESPACE "otaWebUpdater"   // Stores the ETag and Last-Modified of the manifest
+#define OTA_INITIAL_JITTER_MS (2 * 60 * 1000) // Delay the first version check randomly up to this
+#define OTA_CHECK_JITTER_PERCENT 10         // Randomize the version check interval by +-10%
 
 struct OtaWebVersion {
   String date;
   String version;
 };
 
+// Image as announced in the manifest (current-version.json)
+struct OtaWebImage {
+  bool known = false;
+  uint32_t size = 0;
+  uint8_t sha256[32];
+};
+
 void otaTask(void* param);
 
 class OtaWebUpdater {
@@ -60,9 +82,12 @@ class OtaWebUpdater {
     // Execute update
     void executeUpdate();
 
-    // Install a new firmware version
+    // Install a new firmware version, .gz files are decompressed and .patch files applied to the running firmware
     bool updateFile(String baseUrl, String filename);
 
+    // Install the first available of alternative files
+    bool updateAny(String baseUrl, std::initializer_list<String> filenames);
+
     // Set a new baseUrl
     void setBaseUrl(String newUrl) { baseUrl = newUrl; };
 
@@ -100,11 +125,12 @@ class OtaWebUpdater {
     // Task handle for the background task
     TaskHandle_t otaCheckTask = NULL;
 
-    // Time of last version check
-    uint64_t lastVersionCheckMillis = 0;
-    
+    // Time of the next version check
+    uint32_t nextVersionCheckMillis = 0;
+    bool checkScheduled = false;
+
     // Interval to check for new versions (should be hours!!)
-    uint64_t intervalVersionCheckMillis = 12 * 60 * 60 * 1000; // 12 hours
+    uint32_t intervalVersionCheckMillis = 12 * 60 * 60 * 1000; // 12 hours
 
     // Current running firmware compile date
     String currentFwDate = "";
@@ -115,11 +141,24 @@ class OtaWebUpdater {
     // Is the network ready?
     bool networkReady = false;
 
-    // Inital check executed
-    bool initialCheck = false;
-
     // Password to execute OTA upload
     String otaPassword = "";
+
+    // Decompression of a running .gz upload
+    OtaInflate * uploadInflate = NULL;
+
+    // Expected images of the new release
+    OtaWebImage firmwareImage;
+    OtaWebImage filesystemImage;
+
+    // Read an entry of "files" in the manifest
+    void parseImage(JsonObjectConst json, OtaWebImage &image);
+
+    // Check the signature of the manifest, if the firmware contains a public key
+    bool verifyManifest(const String &manifest);
+
+    // Receive a response body into the pipeline, true if the file is complete
+    bool receiveFile(WiFiClient * stream, OtaPipeline &pipeline, size_t &received, int totalLength);
 };
 
 #endif // OTAWEBUPDATER_h
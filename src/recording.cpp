@@ -0,0 +1,106 @@
+/**
+ * @file recording.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Compact binary recordings of raw HX711 readings for a later replay
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "recording.h"
+
+bool RecordingWriter::begin(fs::FS &fs, const String &newPath, const RecordingHeader &header, size_t limit) {
+  end();
+  limit = min(limit, (size_t)RECORDING_MAX_SIZE);
+  if (limit < sizeof(header) + RECORDING_BUFFER_SAMPLES * sizeof(RecordingSample)) return false;
+  if (!fs.exists(RECORDING_DIR) && !fs.mkdir(RECORDING_DIR)) return false;
+  if (lock == NULL) lock = xSemaphoreCreateMutex();
+  if (lock == NULL) return false;
+
+  File file = fs.open(newPath, FILE_WRITE);
+  if (!file) return false;
+  bool written = file.write((const uint8_t *)&header, sizeof(header)) == sizeof(header);
+  file.close();
+  if (!written) return false;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  filesystem = &fs;
+  path = newPath;
+  size = sizeof(header);
+  maxSize = limit;
+  buffered = 0;
+  xSemaphoreGive(lock);
+  return true;
+}
+
+bool RecordingWriter::add(const RecordingSample &sample) {
+  if (lock == NULL) return false;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  bool active = filesystem != nullptr;
+  if (active) {
+    buffer[buffered++] = sample;
+    if (buffered == RECORDING_BUFFER_SAMPLES) active = write();
+  }
+  xSemaphoreGive(lock);
+  return active;
+}
+
+void RecordingWriter::flush() {
+  if (lock == NULL) return;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (filesystem != nullptr) write();
+  xSemaphoreGive(lock);
+}
+
+void RecordingWriter::end() {
+  if (lock == NULL) return;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  if (filesystem != nullptr) write();
+  filesystem = nullptr;
+  xSemaphoreGive(lock);
+}
+
+// Write the buffer, the lock has to be held. Ends the recording on errors or at the size limit.
+bool RecordingWriter::write() {
+  if (buffered == 0) return true;
+  size_t len = buffered * sizeof(RecordingSample);
+  buffered = 0;
+
+  File file = filesystem->open(path, FILE_APPEND);
+  bool written = file && file.write((const uint8_t *)buffer, len) == len;
+  file.close();
+  if (written) size += len;
+  if (!written || size + RECORDING_BUFFER_SAMPLES * sizeof(RecordingSample) > maxSize) {
+    filesystem = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool RecordingReader::begin(fs::File &recording, uint32_t intervalMs) {
+  file = nullptr;
+  interval = intervalMs;
+  first = true;
+  if (!recording || recording.read((uint8_t *)&header, sizeof(header)) != sizeof(header)) return false;
+  if (header.magic != RECORDING_MAGIC || header.sampleSize < sizeof(RecordingSample)) return false;
+  file = &recording;
+  return true;
+}
+
+bool RecordingReader::next(RecordingSample &sample) {
+  if (file == nullptr) return false;
+  for (;;) {
+    if (file->read((uint8_t *)&sample, sizeof(sample)) != sizeof(sample)) return false;
+    // Skip fields of later versions
+    if (header.sampleSize > sizeof(sample)) file->seek(header.sampleSize - sizeof(sample), fs::SeekCur);
+    if (sample.count > RECORDING_RAW_COUNTS) return false;
+    if (!first && sample.time - lastTime < interval) continue;
+    first = false;
+    lastTime = sample.time;
+    return true;
+  }
+}
@@ -0,0 +1,115 @@
+/**
+ * @file recording.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Compact binary recordings of raw HX711 readings for a later replay
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * A recording is a RecordingHeader followed by RecordingSample entries, stored and
+ * transferred as is, little endian. Use header.sampleSize to step through the samples,
+ * later versions may append fields to a sample.
+ */
+
+#ifndef RECORDING_h
+#define RECORDING_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#define RECORDING_DIR "/recordings"             // Directory of the recordings
+#define RECORDING_MAGIC 0x31525347              // "GSR1"
+#define RECORDING_VERSION 1
+#define RECORDING_RAW_COUNTS 10                 // Raw readings per sample, averaged by the pipeline
+#define RECORDING_BUFFER_SAMPLES 12             // Samples kept in RAM before writing them to flash
+#define RECORDING_MAX_SIZE (512 * 1024)         // Upper limit of the size given to RecordingWriter::begin()
+#define RECORDING_MIN_INTERVAL_MS 200           // 10 readings take about 100ms at 80Hz
+
+struct RecordingHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t sampleSize;                          // bytes per sample
+  uint32_t start;                               // time(), seconds since boot if the clock was never set
+  uint32_t intervalMs;                          // sensor interval while recording
+  float scale;                                  // calibration of the scale when the recording started
+  int32_t offset;
+  uint32_t emptyWeight;                         // gramms
+  uint32_t fullWeight;                          // gramms
+};
+
+struct RecordingSample {
+  uint32_t time;                                // ms since the start of the recording
+  int16_t temperature;                          // 0.01 °C, INT16_MIN if unknown
+  uint16_t pressure;                            // 0.1 hPa, 0 if unknown
+  uint8_t count;                                // valid raw readings, 0 if the HX711 did not respond
+  uint8_t reserved;
+  uint8_t raw[RECORDING_RAW_COUNTS][3];         // 24 bit two's complement as read from the HX711
+
+  void setRaw(uint8_t i, long value) {
+    raw[i][0] = value;
+    raw[i][1] = value >> 8;
+    raw[i][2] = value >> 16;
+  }
+  long getRaw(uint8_t i) const {
+    int32_t value = raw[i][0] | raw[i][1] << 8 | raw[i][2] << 16;
+    return value & 0x800000 ? value - 0x1000000 : value;   // sign extend
+  }
+};
+
+// Appends samples to a recording, buffered to reduce flash writes
+class RecordingWriter {
+  public:
+    // Create the file and write the header, an existing recording is replaced.
+    // The recording stops before the file exceeds maxSize.
+    bool begin(fs::FS &fs, const String &path, const RecordingHeader &header, size_t maxSize = RECORDING_MAX_SIZE);
+
+    // Buffer a sample, returns false once the recording has ended (size limit or write error)
+    bool add(const RecordingSample &sample);
+
+    // Write the buffered samples
+    void flush();
+
+    // Write the buffered samples and close the recording
+    void end();
+
+    bool isActive() { return filesystem != nullptr; }
+    String getPath() { return path; }
+
+  private:
+    fs::FS * filesystem = nullptr;
+    String path;
+    size_t size = 0;                            // bytes in the file
+    size_t maxSize = RECORDING_MAX_SIZE;
+    SemaphoreHandle_t lock = NULL;              // held during file access
+
+    RecordingSample buffer[RECORDING_BUFFER_SAMPLES];
+    uint8_t buffered = 0;
+
+    bool write();
+};
+
+// Reads a recording sample by sample
+class RecordingReader {
+  public:
+    // Returns false if the file is no recording. Samples closer than intervalMs to the
+    // previous one are skipped, to simulate a slower sensor interval.
+    bool begin(fs::File &file, uint32_t intervalMs = 0);
+
+    const RecordingHeader &getHeader() { return header; }
+
+    // Read the next sample, returns false at the end of the recording
+    bool next(RecordingSample &sample);
+
+  private:
+    fs::File * file = nullptr;
+    RecordingHeader header;
+    uint32_t interval = 0;
+    uint32_t lastTime = 0;
+    bool first = true;
+};
+
+#endif // RECORDING_h
@@ -0,0 +1,37 @@
+/**
+ * @file rtcclock.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Time since the cold boot, read from the RTC slow clock
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef RTCCLOCK_h
+#define RTCCLOCK_h
+
+#include <Arduino.h>
+#include <soc/rtc.h>
+extern "C" {
+  #if ESP_ARDUINO_VERSION_MAJOR >= 2
+    #include <esp32/clk.h>
+  #else
+    #include <esp_clk.h>
+  #endif
+}
+
+// Microseconds since the cold boot, unlike esp_timer_get_time() it continues during deep sleep
+inline uint64_t rtcMicros() {
+  return rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get());
+}
+
+// Milliseconds since the cold boot
+inline uint64_t runtime() {
+  return rtcMicros() / 1000;
+}
+
+#endif // RTCCLOCK_h
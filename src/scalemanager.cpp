@@ -10,6 +10,7 @@
  * License: CC BY-NC-SA 4.0
  */
 
+#define LOG_MODULE LOG_MOD_SCALE
 #include "log.h"
 
 #include <Arduino.h>
@@ -17,13 +18,12 @@
 #include <HX711.h>
 #include <Preferences.h>
 #include "scalemanager.h"
-#include <soc/rtc.h>
-extern "C" {
-  #if ESP_ARDUINO_VERSION_MAJOR >= 2
-    #include <esp32/clk.h>
-  #else
-    #include <esp_clk.h>
-  #endif
+#include "metrics.h"
+#include "energy.h"
+#include <time.h>
+#include "rtcclock.h"
+
+SCALEMANAGER::SCALEMANAGER() {
 }
 
 SCALEMANAGER::SCALEMANAGER(uint8_t dout, uint8_t pd_sck) {
@@ -50,12 +50,9 @@ void SCALEMANAGER::initHX711() {
 SCALEMANAGER::~SCALEMANAGER() {
 }
 
-uint64_t SCALEMANAGER::runtime() {
-  return rtc_time_slowclk_to_us(rtc_time_get(), esp_clk_slowclk_cal_get()) / 1000;
-}
-
 void SCALEMANAGER::loop() {
-  if (runtime() - timing.lastSensorRead >= timing.sensorIntervalMs) {
+  uint32_t interval = isRecording() ? recordIntervalMs : timing.sensorIntervalMs;
+  if (runtime() - timing.lastSensorRead >= interval) {
     timing.lastSensorRead = runtime();
     getSensorMedianValue(false); // update lastMedian
     if (isConfigured()) {
@@ -64,6 +61,12 @@ void SCALEMANAGER::loop() {
   }
 }
 
+uint32_t SCALEMANAGER::msUntilNextRead() {
+  uint32_t interval = isRecording() ? recordIntervalMs : timing.sensorIntervalMs;
+  uint64_t elapsed = runtime() - timing.lastSensorRead;
+  return elapsed >= interval ? 0 : interval - elapsed;
+}
+
 bool SCALEMANAGER::writeToNVS() {
   if (preferences.begin(NVS.c_str(), false)) {
     SCALE = hx711.get_scale();
@@ -82,7 +85,7 @@ bool SCALEMANAGER::writeToNVS() {
 
     return true;
   } else {
-    LOG_INFO_LN(F("[SCALE] Unable to write data to NVS, giving up..."));
+    LOG_ERROR_LN(F("[SCALE] Unable to write data to NVS, giving up..."));
     return false;
   }
 }
@@ -141,7 +144,7 @@ bool SCALEMANAGER::isConfigured() {
 void SCALEMANAGER::begin(String nvs) {
   NVS = nvs;
   if (!preferences.begin(NVS.c_str(), false)) {
-    LOG_INFO_LN(F("[SCALE] Error opening NVS Namespace, giving up..."));
+    LOG_ERROR_LN(F("[SCALE] Error opening NVS Namespace, giving up..."));
   } else {
     SCALE = preferences.getDouble("scale", 1.f);
     OFFSET = preferences.getULong("offset", 0);
@@ -157,26 +160,49 @@ void SCALEMANAGER::begin(String nvs) {
 
 uint32_t SCALEMANAGER::getSensorMedianValue(bool cached) {
   if (cached) return lastMedian;
+  MetricTimer timer(metricScaleReadDuration);
+  EnergyScope energy(ENERGY_HX711);
   if (hx711.wait_ready_retry(100, 5)) {
     //lastMedian = (int)floor(hx711.get_median_value(10) / 1000);
-    lastMedian = hx711.get_units(10);
-    // LOG_INFO_F("getSensorMedianValue(cached = %s) returned lastMedian = %d\n", cached ? "true" : "false", lastMedian);
-    if (lastMedian == UINT64_MAX) {
-      LOG_INFO_LN(F("[SCALE] Detected UINT64_MAX value, ignoring!"));
-      lastMedian = 0;
+    // Same readings as hx711.get_units(10), the raw values are kept for the recorder
+    long raw[RECORDING_RAW_COUNTS];
+    for (uint8_t i = 0; i < RECORDING_RAW_COUNTS; i++) {
+      raw[i] = hx711.read();
+      delay(0);
     }
+    metricScaleReads.inc();
+    if (isRecording()) recordSample(raw, RECORDING_RAW_COUNTS);
+    applyRawReadings(raw, RECORDING_RAW_COUNTS);
+    // LOG_INFO_F("getSensorMedianValue(cached = %s) returned lastMedian = %d\n", cached ? "true" : "false", lastMedian);
     return lastMedian;
   } else {
-    LOG_INFO_LN(F("[SCALE] Unable to communicate with the HX711 modul."));
+    LOG_ERROR_LN(F("[SCALE] Unable to communicate with the HX711 modul."));
+    metricScaleReadFailures.inc();
+    if (isRecording()) recordSample(NULL, 0);
     return -1;
   }
 }
 
+void SCALEMANAGER::applyRawReadings(const long * raw, uint8_t count) {
+  // Same calculation as HX711::get_units()
+  long sum = 0;
+  for (uint8_t i = 0; i < count; i++) sum += raw[i];
+  double value = sum / count - hx711.get_offset();
+  float units = value / hx711.get_scale();
+  lastMedian = units;
+  if (lastMedian == UINT64_MAX) {
+    LOG_WARN_LN(F("[SCALE] Detected UINT64_MAX value, ignoring!"));
+    lastMedian = 0;
+  }
+}
+
 uint8_t SCALEMANAGER::calculateLevel() {
   if (isConfigured() && lastMedian > fullWeightGramms*10) {
-    LOG_INFO_F("[SCALE] Abnormal reading from hx711 detected (lastMedian = %d), possibly incorrect. Set to 0 to prevent underflow issues.\n",
-      lastMedian = 0
+    // Reset outside of the log macro, its arguments are not evaluated below the log level
+    LOG_WARN_F("[SCALE] Abnormal reading from hx711 detected (lastMedian = %d), possibly incorrect. Set to 0 to prevent underflow issues.\n",
+      lastMedian
     );
+    lastMedian = 0;
   }
   currentGasWeightGramms = (lastMedian > emptyWeightGramms) ? lastMedian - emptyWeightGramms : 0;
   uint32_t maxGasWeight = fullWeightGramms - emptyWeightGramms;
@@ -214,9 +240,92 @@ bool SCALEMANAGER::setBottleWeight(uint32_t newEmptyWeightGramms, uint32_t newFu
     LOG_INFO_F("[SCALE] New bottle weight configured. Empty = %d, Full = %d\n", newEmptyWeightGramms, newFullWeightGramms);
     return true;
   }
-  LOG_INFO_F("[SCALE] Unable to configure the new Bottle weight! Given data empty = %d, full = %d\n", newEmptyWeightGramms, newFullWeightGramms);
+  LOG_ERROR_F("[SCALE] Unable to configure the new Bottle weight! Given data empty = %d, full = %d\n", newEmptyWeightGramms, newFullWeightGramms);
   return false;
 }
 
 uint32_t SCALEMANAGER::getBottleEmptyWeight() { return (uint32_t)emptyWeightGramms; }
 uint32_t SCALEMANAGER::getBottleFullWeight() { return (uint32_t)fullWeightGramms; }
+
+void SCALEMANAGER::setEnvironment(float temperature, float pressure) {
+  envTemperature = temperature;
+  envPressure = pressure;
+}
+
+bool SCALEMANAGER::startRecording(fs::FS &fs, const String &path, uint32_t intervalMs, size_t maxSize) {
+  RecordingHeader header;
+  header.magic = RECORDING_MAGIC;
+  header.version = RECORDING_VERSION;
+  header.sampleSize = sizeof(RecordingSample);
+  header.start = time(NULL);
+  header.intervalMs = max(intervalMs, (uint32_t)RECORDING_MIN_INTERVAL_MS);
+  header.scale = hx711.get_scale();
+  header.offset = hx711.get_offset();
+  header.emptyWeight = emptyWeightGramms;
+  header.fullWeight = fullWeightGramms;
+
+  if (!recorder.begin(fs, path, header, maxSize)) {
+    LOG_ERROR_F("[SCALE] Unable to start the recording to %s\n", path.c_str());
+    return false;
+  }
+  recordIntervalMs = header.intervalMs;
+  recordStart = runtime();
+  LOG_INFO_F("[SCALE] Recording raw readings every %ums to %s\n", recordIntervalMs, path.c_str());
+  return true;
+}
+
+void SCALEMANAGER::stopRecording() {
+  if (!isRecording()) return;
+  recorder.end();
+  LOG_INFO_F("[SCALE] Recording to %s stopped\n", recorder.getPath().c_str());
+}
+
+bool SCALEMANAGER::isRecording() {
+  return recorder.isActive();
+}
+
+void SCALEMANAGER::flushRecording() {
+  recorder.flush();
+}
+
+void SCALEMANAGER::recordSample(const long * raw, uint8_t count) {
+  RecordingSample sample;
+  memset(&sample, 0, sizeof(sample));
+  sample.time = runtime() - recordStart;
+  sample.temperature = isnan(envTemperature) ? INT16_MIN : constrain(lroundf(envTemperature * 100), INT16_MIN + 1, INT16_MAX);
+  sample.pressure = isnan(envPressure) ? 0 : constrain(lroundf(envPressure * 10), 0, UINT16_MAX);
+  sample.count = count;
+  for (uint8_t i = 0; i < count; i++) sample.setRaw(i, raw[i]);
+  if (!recorder.add(sample)) {
+    LOG_WARN_F("[SCALE] Recording to %s ended, size limit reached or unable to write\n", recorder.getPath().c_str());
+  }
+}
+
+void SCALEMANAGER::applyRecordingConfig(const RecordingHeader &header) {
+  SCALE = header.scale;
+  OFFSET = header.offset;
+  hx711.set_scale(header.scale);
+  hx711.set_offset(header.offset);
+  emptyWeightGramms = header.emptyWeight;
+  fullWeightGramms = header.fullWeight;
+}
+
+void SCALEMANAGER::replaySample(const RecordingSample &sample) {
+  long raw[RECORDING_RAW_COUNTS];
+  for (uint8_t i = 0; i < sample.count; i++) raw[i] = sample.getRaw(i);
+  // A failed read keeps the last value, as in loop()
+  if (sample.count) applyRawReadings(raw, sample.count);
+  if (isConfigured()) calculateLevel();
+}
+
+uint32_t SCALEMANAGER::replay(RecordingReader &recording, ReplayOutput output) {
+  applyRecordingConfig(recording.getHeader());
+  uint32_t replayed = 0;
+  RecordingSample sample;
+  while (recording.next(sample)) {
+    replaySample(sample);
+    replayed++;
+    if (output) output(sample, *this);
+  }
+  return replayed;
+}
@@ -17,6 +17,13 @@
 #include <Arduino.h>
 #include <Preferences.h>
 #include <HX711.h>
+#include <functional>
+#include "recording.h"
+
+class SCALEMANAGER;
+
+// Called after every replayed sample, with the scale holding the results of the pipeline
+typedef std::function<void(const RecordingSample &sample, SCALEMANAGER &scale)> ReplayOutput;
 
 class SCALEMANAGER
 {
@@ -45,6 +52,9 @@ class SCALEMANAGER
         // Read Median(10) raw value from sensor
         uint32_t getSensorMedianValue(bool cached = false);
 
+        // Filter raw readings of the HX711 into lastMedian, for live and replayed readings
+        void applyRawReadings(const long * raw, uint8_t count);
+
         // Set the level variable to 0-100 according to the current state of lastMedian
         // You need to call getSensorMedianValue() before calculateLevel() to update lastMedian
         uint8_t calculateLevel();
@@ -60,7 +70,19 @@ class SCALEMANAGER
         uint8_t PD_SCK = 0;
         uint8_t GAIN = 128;
 
+        // Recorder of the raw readings
+        RecordingWriter recorder;
+        uint32_t recordIntervalMs = 0;                  // sensor interval while recording
+        uint64_t recordStart = 0;                       // runtime at the start of the recording
+        float envTemperature = NAN;                     // last environment reading, stored with the samples
+        float envPressure = NAN;
+
+        // Append a sample to the recording, raw is NULL if the read failed
+        void recordSample(const long * raw, uint8_t count);
+
 	public:
+        // Without a sensor, e.g. to replay a recording
+        SCALEMANAGER();
 		SCALEMANAGER(uint8_t dout, uint8_t pd_sck);
         SCALEMANAGER(uint8_t dout, uint8_t pd_sck, uint8_t gain);
 		virtual ~SCALEMANAGER();
@@ -83,6 +105,9 @@ class SCALEMANAGER
         // call loop
         void loop();
 
+        // Time in ms until loop() reads the sensor again
+        uint32_t msUntilNextRead();
+
         // Initialize the Webserver
 		void begin(String nvs);
 
@@ -105,8 +130,26 @@ class SCALEMANAGER
         uint32_t getBottleEmptyWeight();
         uint32_t getBottleFullWeight();
 
-        // helper to get ESP32 runtime
-        uint64_t runtime();
+        // Latest temperature (°C) and pressure (hPa), stored in recordings
+        void setEnvironment(float temperature, float pressure);
+
+        // Record the raw readings to path, the sensor is read every intervalMs while recording.
+        // The recording stops before the file exceeds maxSize.
+        bool startRecording(fs::FS &fs, const String &path, uint32_t intervalMs, size_t maxSize = RECORDING_MAX_SIZE);
+        void stopRecording();
+        bool isRecording();
+
+        // Write buffered samples, e.g. before downloading the recording
+        void flushRecording();
+
+        // Use the calibration and bottle weights stored in a recording, nothing is written to NVS
+        void applyRecordingConfig(const RecordingHeader &header);
+
+        // Feed a single recorded sample through the pipeline, as loop() does with a live reading
+        void replaySample(const RecordingSample &sample);
+
+        // Replay a whole recording as fast as possible with its calibration, returns the replayed samples
+        uint32_t replay(RecordingReader &recording, ReplayOutput output);
 };
 
 #endif /* SCALEMANAGER_h */
@@ -0,0 +1,61 @@
+/**
+ * @file seqlock.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Lock free exchange of a value between one writer and any number of readers
+ * @version 0.1
+ * @date 2023-02-15
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef SEQLOCK_h
+#define SEQLOCK_h
+
+#include <atomic>
+#include <stdint.h>
+
+// The writer never blocks, readers retry if the value changed while copying it.
+// T has to be trivially copyable.
+template <typename T>
+class SeqLock {
+  public:
+    // Only a single writer is allowed
+    void write(const T &value) {
+      uint32_t s = seq.load(std::memory_order_relaxed);
+      seq.store(s + 1, std::memory_order_relaxed);   // odd while writing
+      std::atomic_thread_fence(std::memory_order_release);
+      data = value;
+      seq.store(s + 2, std::memory_order_release);
+    }
+
+    // Copy the latest value, returns the number of writes so far (0 if nothing was written yet)
+    uint32_t read(T &value) const {
+      for (;;) {
+        uint32_t before = seq.load(std::memory_order_acquire);
+        if (before & 1) continue;
+        value = data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq.load(std::memory_order_relaxed) == before) return before / 2;
+      }
+    }
+
+  private:
+    std::atomic<uint32_t> seq{0};
+    T data;
+};
+
+// Hand the latest value of lock to publish, unless it was published before. Values written
+// while publish was busy are skipped. published keeps the read() result of the last one.
+template <typename T, typename F>
+bool publishLatest(const SeqLock<T> &lock, T &value, uint32_t &published, F publish) {
+  uint32_t seq = lock.read(value);
+  if (seq == published) return false;
+  published = seq;
+  publish(value);
+  return true;
+}
+
+#endif // SEQLOCK_h
@@ -0,0 +1,138 @@
+/**
+ * @file telemetry.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Periodic sampling of task stacks, CPU usage and heap fragmentation
+ * @version 0.1
+ * @date 2023-02-13
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "telemetry.h"
+#include "metrics.h"
+#include <esp_heap_caps.h>
+
+TelemetryClass Telemetry;
+
+bool TelemetryClass::startBackgroundTask() {
+  if (sampleTask != NULL) return true;
+  BaseType_t xReturned = xTaskCreate(
+    telemetryTask,
+    "Telemetry",
+    3072,   // Stack size in words
+    this,   // Task input parameter
+    0,      // Priority of the task
+    &sampleTask  // Task handle.
+  );
+  if (xReturned != pdPASS) {
+    Serial.println(F("[TELEMETRY] Unable to run the background Task"));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Background Task sampling the system state
+ * @param param needs to be a valid TelemetryClass instance
+ */
+void telemetryTask(void* param) {
+  TelemetryClass * telemetry = (TelemetryClass *) param;
+  for(;;) {
+    telemetry->sample();
+    vTaskDelay(TELEMETRY_INTERVAL_MS / portTICK_PERIOD_MS);
+  }
+}
+
+void TelemetryClass::sample() {
+  TelemetryTask result[TELEMETRY_MAX_TASKS];
+  uint8_t count = 0;
+
+#if configUSE_TRACE_FACILITY
+  uint32_t totalRunTime = 0;
+  // returns 0 if there are more tasks than entries
+  count = uxTaskGetSystemState(status, TELEMETRY_MAX_TASKS, &totalRunTime);
+
+  for (uint8_t i = 0; i < count; i++) {
+    TelemetryTask &task = result[i];
+    strlcpy(task.name, status[i].pcTaskName, sizeof(task.name));
+    task.priority = status[i].uxCurrentPriority;
+    task.stackFree = status[i].usStackHighWaterMark;  // ESP-IDF counts the stack in bytes
+  #if configTASKLIST_INCLUDE_COREID
+    task.core = status[i].xCoreID == tskNO_AFFINITY ? -1 : status[i].xCoreID;
+  #else
+    task.core = -1;
+  #endif
+    task.cpu = -1;
+  #if configGENERATE_RUN_TIME_STATS
+    // usage of a single core since the last sample
+    uint32_t elapsed = totalRunTime - lastTotalRunTime;
+    for (uint8_t j = 0; j < lastCount && elapsed; j++) {
+      if (lastHandle[j] != status[i].xHandle) continue;
+      task.cpu = 100.f * (status[i].ulRunTimeCounter - lastRunTime[j]) / elapsed;
+      break;
+    }
+  #endif
+  }
+
+  #if configGENERATE_RUN_TIME_STATS
+    for (uint8_t i = 0; i < count; i++) {
+      lastHandle[i] = status[i].xHandle;
+      lastRunTime[i] = status[i].ulRunTimeCounter;
+    }
+    lastCount = count;
+    lastTotalRunTime = totalRunTime;
+  #endif
+#endif
+
+  TelemetryHeap heap;
+  heap.uptime = esp_timer_get_time() / 1000000;
+  heap.freeHeap = esp_get_free_heap_size();
+  heap.minFreeHeap = esp_get_minimum_free_heap_size();
+  heap.largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  metricLargestFreeBlock.set(heap.largestBlock);
+
+  portENTER_CRITICAL(&mux);
+  memcpy(tasks, result, count * sizeof(TelemetryTask));
+  taskCount = count;
+  trend[trendHead % TELEMETRY_TREND_SIZE] = heap;
+  trendHead++;
+  portEXIT_CRITICAL(&mux);
+}
+
+void TelemetryClass::printJson(Print &out) {
+  TelemetryTask snapshot[TELEMETRY_MAX_TASKS];
+  TelemetryHeap heap[TELEMETRY_TREND_SIZE];
+
+  portENTER_CRITICAL(&mux);
+  uint8_t count = taskCount;
+  memcpy(snapshot, tasks, count * sizeof(TelemetryTask));
+  uint32_t trendCount = min(trendHead, (uint32_t)TELEMETRY_TREND_SIZE);
+  for (uint32_t i = 0; i < trendCount; i++) heap[i] = trend[(trendHead - trendCount + i) % TELEMETRY_TREND_SIZE];
+  portEXIT_CRITICAL(&mux);
+
+  uint32_t freeHeap = esp_get_free_heap_size();
+  uint32_t largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  out.printf("{\"heap\":{\"free\":%u,\"minFree\":%u,\"largestBlock\":%u,\"fragmentation\":%u},",
+    freeHeap, esp_get_minimum_free_heap_size(), largestBlock,
+    freeHeap ? 100 - (uint32_t)(100ULL * largestBlock / freeHeap) : 0
+  );
+
+  out.print("\"tasks\":[");
+  for (uint8_t i = 0; i < count; i++) {
+    out.printf("%s{\"name\":\"%s\",\"core\":%d,\"priority\":%u,\"stackFree\":%u,\"cpu\":",
+      i ? "," : "", snapshot[i].name, snapshot[i].core, snapshot[i].priority, snapshot[i].stackFree
+    );
+    if (snapshot[i].cpu < 0) out.print("null}");
+    else out.printf("%.1f}", snapshot[i].cpu);
+  }
+
+  // compact rows of [uptime, free, minFree, largestBlock]
+  out.printf("],\"interval\":%u,\"trend\":[", TELEMETRY_INTERVAL_MS / 1000);
+  for (uint32_t i = 0; i < trendCount; i++) {
+    out.printf("%s[%u,%u,%u,%u]", i ? "," : "", heap[i].uptime, heap[i].freeHeap, heap[i].minFreeHeap, heap[i].largestBlock);
+  }
+  out.print("]}");
+}
@@ -0,0 +1,77 @@
+/**
+ * @file telemetry.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Periodic sampling of task stacks, CPU usage and heap fragmentation
+ * @version 0.1
+ * @date 2023-02-13
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef TELEMETRY_h
+#define TELEMETRY_h
+
+#include <Arduino.h>
+
+#define TELEMETRY_INTERVAL_MS (60 * 1000)   // Sampling interval
+#define TELEMETRY_TREND_SIZE 60             // Heap samples kept in RAM (1 hour)
+#define TELEMETRY_MAX_TASKS 32              // Max number of reported tasks
+
+struct TelemetryTask {
+  char name[configMAX_TASK_NAME_LEN];
+  int8_t core;                              // -1 if not pinned or unknown
+  uint8_t priority;
+  uint32_t stackFree;                       // Lowest free stack since the task started (bytes)
+  float cpu;                                // CPU usage within the last interval (percent), -1 if unknown
+};
+
+struct TelemetryHeap {
+  uint32_t uptime;                          // seconds
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;
+  uint32_t largestBlock;
+};
+
+void telemetryTask(void* param);
+
+class TelemetryClass {
+  public:
+    // Starts the sampling task
+    bool startBackgroundTask();
+
+    // Take a new sample of all tasks and the heap
+    void sample();
+
+    // Write the last sample and the trend as JSON
+    void printJson(Print &out);
+
+  private:
+    TaskHandle_t sampleTask = NULL;
+
+    // Protects the results below, only held while copying
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+    TelemetryTask tasks[TELEMETRY_MAX_TASKS];
+    uint8_t taskCount = 0;
+
+    TelemetryHeap trend[TELEMETRY_TREND_SIZE];
+    uint32_t trendHead = 0;                 // free running counter
+
+#if configUSE_TRACE_FACILITY
+    TaskStatus_t status[TELEMETRY_MAX_TASKS];
+  #if configGENERATE_RUN_TIME_STATS
+    // Runtime counters of the previous sample to calculate the usage within the interval
+    TaskHandle_t lastHandle[TELEMETRY_MAX_TASKS];
+    uint32_t lastRunTime[TELEMETRY_MAX_TASKS];
+    uint8_t lastCount = 0;
+    uint32_t lastTotalRunTime = 0;
+  #endif
+#endif
+};
+
+extern TelemetryClass Telemetry;
+
+#endif // TELEMETRY_h
@@ -10,8 +10,11 @@
  * License: CC BY-NC-SA 4.0
  */
 
+#define LOG_MODULE LOG_MOD_WEB
 #include "log.h"
 #include <webserial.h>
+#include "metrics.h"
+#include "logfile.h"
 
 void WebSerialClass::begin(AsyncWebServer *server, const char* url) {
   webServer = server;
@@ -19,6 +22,7 @@ void WebSerialClass::begin(AsyncWebServer *server, const char* url) {
   webSocket = new AsyncWebSocket("/api/webserial");
   webSocket->onEvent([&](AsyncWebSocket * server, AsyncWebSocketClient * client, AwsEventType type, void * arg, uint8_t *data, size_t len) -> void {
     if(type == WS_EVT_CONNECT){
+      sendBacklog(client);
       LOG_INFO_LN(F("[WEBSERIAL] Client connection received"));
     } else if(type == WS_EVT_DISCONNECT){
       LOG_INFO_LN(F("[WEBSERIAL] Client disconnected"));
@@ -28,87 +32,183 @@ void WebSerialClass::begin(AsyncWebServer *server, const char* url) {
   });
   webServer->addHandler(webSocket);
 
+  startBackgroundTask();
+
   LOG_INFO_LN(F("[WEBSERIAL] Attached AsyncWebServer along with Websockets"));
 }
 
+bool WebSerialClass::startBackgroundTask() {
+  if (flushTask != NULL) return true;
+  BaseType_t xReturned = xTaskCreate(
+    webSerialTask,
+    "WebSerial",
+    4096,   // Stack size in words
+    this,   // Task input parameter
+    0,      // Priority of the task
+    &flushTask  // Task handle.
+  );
+  if (xReturned != pdPASS) {
+    Serial.println(F("[WEBSERIAL] Unable to run the background Task"));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Background Task sending the buffered output in batches
+ * @param param needs to be a valid WebSerialClass instance
+ */
+void webSerialTask(void* param) {
+  WebSerialClass * webSerial = (WebSerialClass *) param;
+  for(;;) {
+    webSerial->flush();
+    vTaskDelay(WEBSERIAL_FLUSH_MS / portTICK_PERIOD_MS);
+  }
+}
+
+void WebSerialClass::write(const char * data, size_t len) {
+  if (len > WEBSERIAL_RING_SIZE) {
+    data += len - WEBSERIAL_RING_SIZE;
+    len = WEBSERIAL_RING_SIZE;
+  }
+
+  portENTER_CRITICAL(&mux);
+  uint32_t freeBytes = WEBSERIAL_RING_SIZE - (ringHead - ringTail);
+  if (len > freeBytes) ringTail += len - freeBytes;
+  uint32_t pos = ringHead % WEBSERIAL_RING_SIZE;
+  size_t first = min(len, (size_t)(WEBSERIAL_RING_SIZE - pos));
+  memcpy(ring + pos, data, first);
+  memcpy(ring, data + first, len - first);
+  ringHead += len;
+  portEXIT_CRITICAL(&mux);
+
+  if (len > freeBytes) metricWebSerialDropped.inc(len - freeBytes);
+}
+
+void WebSerialClass::flush() {
+  // Called by the background task and before deep sleep
+  while (flushing.test_and_set()) vTaskDelay(1);
+
+  LOG_FLUSH();
+
+  for(;;) {
+    portENTER_CRITICAL(&mux);
+    size_t len = min((size_t)(ringHead - ringTail), sizeof(batch));
+    uint32_t pos = ringTail % WEBSERIAL_RING_SIZE;
+    size_t first = min(len, (size_t)(WEBSERIAL_RING_SIZE - pos));
+    memcpy(batch, ring + pos, first);
+    memcpy(batch + first, ring, len - first);
+    ringTail += len;
+
+    // keep a copy for clients connecting later
+    for (size_t i = 0; i < len; i++) backlog[(backlogHead + i) % WEBSERIAL_BACKLOG_SIZE] = batch[i];
+    backlogHead += len;
+    portEXIT_CRITICAL(&mux);
+
+    if (len == 0) break;
+    LogFile.write(batch, len);
+    if (webSocket != nullptr && webSocket->count()) webSocket->textAll(batch, len);
+    if (len < sizeof(batch)) break;
+  }
+
+  // rate limited, usually returns without touching the filesystem
+  LogFile.flush();
+  flushing.clear();
+}
+
+void WebSerialClass::sendBacklog(AsyncWebSocketClient * client) {
+  char * buffer = (char *) malloc(WEBSERIAL_BACKLOG_SIZE);
+  if (buffer == NULL) return;
+
+  portENTER_CRITICAL(&mux);
+  size_t len = min(backlogHead, (uint32_t)WEBSERIAL_BACKLOG_SIZE);
+  for (size_t i = 0; i < len; i++) buffer[i] = backlog[(backlogHead - len + i) % WEBSERIAL_BACKLOG_SIZE];
+  portEXIT_CRITICAL(&mux);
+
+  if (len) client->text(buffer, len);
+  free(buffer);
+}
+
 void WebSerialClass::print(int c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(uint8_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(uint16_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(uint32_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(long int c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(double c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(float c) {
-  if (webServer != nullptr) webSocket->textAll(String(c));
+  print(String(c));
 }
 
 void WebSerialClass::print(const char * c) {
-  if (webServer != nullptr) webSocket->textAll(c);
+  write(c, strlen(c));
 }
 
 void WebSerialClass::print(char * c) {
-  if (webServer != nullptr) webSocket->textAll(c);
+  write(c, strlen(c));
 }
 
 void WebSerialClass::print(String c) {
-  if (webServer != nullptr) webSocket->textAll(c);
+  write(c.c_str(), c.length());
 }
 
 void WebSerialClass::println(int c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(uint8_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(uint16_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(uint32_t c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(long int c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(float c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(double c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println(String(c));
 }
 
 void WebSerialClass::println(const char * c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  write(c, strlen(c));
+  write("\n", 1);
 }
 
 void WebSerialClass::println(char * c) {
-  if (webServer != nullptr) webSocket->textAll(String(c) + "\n");        
+  println((const char *)c);
 }
 
 void WebSerialClass::println(String c) {
-  if (webServer != nullptr) webSocket->textAll(c + "\n");        
+  write(c.c_str(), c.length());
+  write("\n", 1);
 }
 
 
@@ -136,7 +236,7 @@ size_t WebSerialClass::printf(const char *format, ...) {
   }
   va_end(arg);
 
-  print(String((uint8_t*)temp, len));
+  write(temp, len);
 
   if(temp != loc_buf) free(temp);
   return len;
@@ -3,10 +3,10 @@
  * @author Martin Verges <martin@verges.cc>
  * @version 0.1
  * @date 2022-08-16
- * 
+ *
  * @copyright Copyright (c) 2022 by the author alone
  *            https://gitlab.womolin.de/martin.verges/gaslevel
- * 
+ *
  * License: CC BY-NC-SA 4.0
  */
 
@@ -14,11 +14,22 @@
 #define WEBSERIAL_h
 
 #include <ESPAsyncWebServer.h>
+#include <atomic>
+
+#define WEBSERIAL_RING_SIZE 4096            // Bytes buffered until the flush task sends them
+#define WEBSERIAL_BACKLOG_SIZE 2048         // Bytes of recent output sent to newly connected clients
+#define WEBSERIAL_BATCH_SIZE 1024           // Max bytes sent within one websocket frame
+#define WEBSERIAL_FLUSH_MS 100              // Interval of the flush task
+
+void webSerialTask(void* param);
 
 class WebSerialClass {
     public:
         void begin(AsyncWebServer *server, const char* url = "/api/webserial");
 
+        // Start the flush task, also required without a webserver to feed the log file
+        bool startBackgroundTask();
+
         void print(int c);
         void print(uint8_t c);
         void print(uint16_t c);
@@ -43,9 +54,36 @@ class WebSerialClass {
 
         size_t printf(const char *format, ...);
 
+        // Copy data into the ring buffer, the oldest data is dropped if it is full
+        void write(const char * data, size_t len);
+
+        // Send buffered data to all clients and the log file, called from the background task.
+        // Waits if another task is flushing.
+        void flush();
+
     private:
-        AsyncWebSocket * webSocket;
+        AsyncWebSocket * webSocket = nullptr;
         AsyncWebServer * webServer = nullptr;
+        TaskHandle_t flushTask = NULL;
+
+        // Protects the ring buffer and the backlog, only held while copying
+        portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+        // Output not yet sent to the clients, head and tail are free running counters
+        char ring[WEBSERIAL_RING_SIZE];
+        uint32_t ringHead = 0;
+        uint32_t ringTail = 0;
+
+        // Recent output to replay on connect
+        char backlog[WEBSERIAL_BACKLOG_SIZE];
+        uint32_t backlogHead = 0;
+
+        // Data of a single websocket frame, not on the stack as LogFile.flush() and the
+        // deferred log drain run in the same frame. Owned by the task holding flushing.
+        char batch[WEBSERIAL_BATCH_SIZE];
+        std::atomic_flag flushing = ATOMIC_FLAG_INIT;
+
+        void sendBacklog(AsyncWebSocketClient * client);
 };
 
 #endif // WEBSERIAL_h
@@ -0,0 +1,138 @@
+/**
+ * @file webui.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @version 0.1
+ * @date 2023-02-04
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#define LOG_MODULE LOG_MOD_WEB
+#include "log.h"
+
+#include "webui.h"
+#include "metrics.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+
+#ifdef WEBUI_EMBEDDED
+#include "webui_embedded.h"
+
+static constexpr int constexprStrcmp(const char * a, const char * b) {
+  return (*a != *b || *a == '\0') ? (unsigned char)*a - (unsigned char)*b : constexprStrcmp(a + 1, b + 1);
+}
+static constexpr bool assetsSorted(size_t i = 1) {
+  return i >= WEBUI_ASSET_COUNT || (constexprStrcmp(WEBUI_ASSETS[i-1].path, WEBUI_ASSETS[i].path) < 0 && assetsSorted(i + 1));
+}
+static_assert(assetsSorted(), "WEBUI_ASSETS needs to be sorted by path");
+
+bool WebUiHandler::begin(fs::FS &fs, const char * manifest) {
+  LOG_INFO_F("[WEBUI] Serving %u assets embedded in the firmware\n", WEBUI_ASSET_COUNT);
+  return true;
+}
+
+bool WebUiHandler::isReady() { return WEBUI_ASSET_COUNT > 0; }
+
+const WebAsset * WebUiHandler::find(const String &path) {
+  auto last = WEBUI_ASSETS + WEBUI_ASSET_COUNT;
+  auto it = std::lower_bound(WEBUI_ASSETS, last, path.c_str(), [](const WebAsset &a, const char * p) { return strcmp(a.path, p) < 0; });
+  if (it == last || strcmp(it->path, path.c_str()) != 0) return nullptr;
+  return it;
+}
+
+#else
+
+bool WebUiHandler::begin(fs::FS &fs, const char * manifest) {
+  filesystem = &fs;
+  assets.clear();
+
+  File file = fs.open(manifest, "r");
+  if (!file) {
+    LOG_INFO_LN(F("[WEBUI] No asset manifest found, serving the UI without ETags"));
+    return false;
+  }
+
+  DynamicJsonDocument doc(file.size() * 2 + 512);
+  DeserializationError error = deserializeJson(doc, file);
+  file.close();
+  if (error) {
+    LOG_ERROR_F("[WEBUI] Unable to parse %s: %s\n", manifest, error.c_str());
+    return false;
+  }
+
+  JsonObject files = doc["files"].as<JsonObject>();
+  assets.reserve(files.size());
+  for (JsonPair kv : files) {
+    assets.push_back({
+      kv.key().c_str(),
+      kv.value()["etag"].as<String>(),
+      kv.value()["gzip"].as<bool>(),
+      kv.value()["immutable"].as<bool>()
+    });
+  }
+  std::sort(assets.begin(), assets.end(), [](const WebAsset &a, const WebAsset &b) { return a.path < b.path; });
+
+  LOG_INFO_F("[WEBUI] Loaded manifest with %u assets\n", assets.size());
+  return true;
+}
+
+bool WebUiHandler::isReady() { return !assets.empty(); }
+
+const WebAsset * WebUiHandler::find(const String &path) {
+  auto it = std::lower_bound(assets.begin(), assets.end(), path, [](const WebAsset &a, const String &p) { return a.path < p; });
+  if (it == assets.end() || it->path != path) return nullptr;
+  return &(*it);
+}
+
+#endif // WEBUI_EMBEDDED
+
+bool WebUiHandler::canHandle(AsyncWebServerRequest *request) {
+  if (request->method() != HTTP_GET && request->method() != HTTP_HEAD) return false;
+
+  String path = request->url();
+  if (path.endsWith("/")) path += "index.html";
+  if (find(path) == nullptr) return false;
+
+  request->addInterestingHeader("If-None-Match");
+  return true;
+}
+
+void WebUiHandler::handleRequest(AsyncWebServerRequest *request) {
+  MetricTimer timer(metricHttpRequestDuration);
+  String path = request->url();
+  if (path.endsWith("/")) path += "index.html";
+  send(request, find(path));
+}
+
+void WebUiHandler::sendIndex(AsyncWebServerRequest *request) {
+  request->addInterestingHeader("If-None-Match");
+  send(request, find("/index.html"));
+}
+
+void WebUiHandler::send(AsyncWebServerRequest *request, const WebAsset * asset) {
+  if (asset == nullptr) return request->send(404, "text/plain", "Not found");
+
+  String etag = String("\"") + asset->etag + "\"";
+  const char * cacheControl = asset->immutable ? "public, max-age=31536000, immutable" : "no-cache";
+
+  AsyncWebServerResponse *response;
+  if (request->hasHeader("If-None-Match") && request->header("If-None-Match") == etag) {
+    response = request->beginResponse(304);
+  } else {
+#ifdef WEBUI_EMBEDDED
+    // AsyncProgmemResponse copies directly from the mapped flash into the TCP buffer
+    response = request->beginResponse_P(200, asset->contentType, asset->data, asset->length);
+    if (asset->gzip) response->addHeader("Content-Encoding", "gzip");
+#else
+    // AsyncFileResponse picks up <path>.gz and sets "Content-Encoding: gzip" on its own,
+    // the content type is still derived from the uncompressed path.
+    response = request->beginResponse(*filesystem, asset->path);
+#endif
+  }
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", cacheControl);
+  request->send(response);
+}
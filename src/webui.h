@@ -0,0 +1,74 @@
+/**
+ * @file webui.h
+ * @author Martin Verges <martin@verges.cc>
+ * @version 0.1
+ * @date 2023-02-04
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef WEBUI_h
+#define WEBUI_h
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <FS.h>
+#include <vector>
+
+#define WEBUI_MANIFEST "/assets.json"           // Manifest written by tools/webui_assets.py
+
+#ifdef WEBUI_EMBEDDED
+// Compiled into the firmware by tools/webui_embedder.py
+struct WebAsset {
+  const char * path;                            // URL path of the asset, e.g. /index.html
+  const char * etag;                            // Content hash of the uncompressed file
+  const char * contentType;                     // MIME type of the uncompressed file
+  const uint8_t * data;                         // Payload in the mapped flash
+  uint32_t length;                              // Length of the payload
+  bool gzip;                                    // Payload is gzip compressed
+  bool immutable;                               // Hashed filename, can be cached forever
+};
+#else
+// Loaded from the LittleFS manifest written by tools/webui_assets.py
+struct WebAsset {
+  String path;                                  // URL path of the asset, e.g. /index.html
+  String etag;                                  // Content hash of the uncompressed file
+  bool gzip;                                    // Stored as <path>.gz
+  bool immutable;                               // Hashed filename, can be cached forever
+};
+#endif
+
+class WebUiHandler : public AsyncWebHandler {
+  public:
+    // Load the asset manifest from the filesystem (ignored with WEBUI_EMBEDDED)
+    bool begin(fs::FS &fs, const char * manifest = WEBUI_MANIFEST);
+
+    // Are there assets available to serve
+    bool isReady();
+
+    // Send the SPA entry point (index.html) for any unknown route
+    void sendIndex(AsyncWebServerRequest *request);
+
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    bool isRequestHandlerTrivial() override { return true; }
+
+  private:
+#ifndef WEBUI_EMBEDDED
+    fs::FS * filesystem = nullptr;
+
+    // Assets sorted by path to allow a binary search
+    std::vector<WebAsset> assets;
+#endif
+
+    // Find an asset by its URL path, returns nullptr if unknown
+    const WebAsset * find(const String &path);
+
+    // Send the asset or a 304 if the client already has it
+    void send(AsyncWebServerRequest *request, const WebAsset * asset);
+};
+
+#endif // WEBUI_h
@@ -0,0 +1,328 @@
+/**
+ * @file Arduino.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Minimal stand-in of the Arduino core and FreeRTOS for host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * Time starts at 0 with the first call and follows the host clock. delay() and
+ * hostClockAdvance() move it forward without sleeping, so tests run faster than real time.
+ */
+
+#ifndef ARDUINO_STANDIN_h
+#define ARDUINO_STANDIN_h
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+#define ESP_ARDUINO_VERSION_MAJOR 2
+#define IRAM_ATTR
+#define RTC_DATA_ATTR
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+using std::min;
+using std::max;
+using std::isnan;
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Host clock
+inline std::atomic<int64_t> hostClockOffsetUs{0};
+
+inline int64_t hostMicros() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count() + hostClockOffsetUs;
+}
+
+inline void hostClockAdvance(uint32_t ms) { hostClockOffsetUs += (int64_t)ms * 1000; }
+
+inline unsigned long millis() { return hostMicros() / 1000; }
+inline unsigned long micros() { return hostMicros(); }
+inline void delay(uint32_t ms) { hostClockAdvance(ms); }
+inline void yield() {}
+
+// Strings
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+class String {
+  public:
+    String() {}
+    String(const char * s) : value(s ? s : "") {}
+    String(const std::string &s) : value(s) {}
+    String(const __FlashStringHelper * s) : value(reinterpret_cast<const char *>(s)) {}
+    explicit String(char c) : value(1, c) {}
+    explicit String(int n) : value(std::to_string(n)) {}
+    explicit String(unsigned int n) : value(std::to_string(n)) {}
+    explicit String(long n) : value(std::to_string(n)) {}
+    explicit String(unsigned long n) : value(std::to_string(n)) {}
+    explicit String(long long n) : value(std::to_string(n)) {}
+    explicit String(unsigned long long n) : value(std::to_string(n)) {}
+    explicit String(float n, unsigned int decimals = 2) : String((double)n, decimals) {}
+    explicit String(double n, unsigned int decimals = 2) {
+      char buffer[64];
+      snprintf(buffer, sizeof(buffer), "%.*f", decimals, n);
+      value = buffer;
+    }
+
+    const char * c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+    bool isEmpty() const { return value.empty(); }
+    bool reserve(unsigned int size) { value.reserve(size); return true; }
+
+    bool concat(const String &s) { value += s.value; return true; }
+    bool concat(const char * s) { if (s) value += s; return s != nullptr; }
+    bool concat(char c) { value += c; return true; }
+    String &operator+=(const String &s) { concat(s); return *this; }
+    String &operator+=(const char * s) { concat(s); return *this; }
+    String &operator+=(char c) { concat(c); return *this; }
+
+    bool operator==(const String &s) const { return value == s.value; }
+    bool operator==(const char * s) const { return value == (s ? s : ""); }
+    bool operator!=(const String &s) const { return value != s.value; }
+    bool operator!=(const char * s) const { return !(*this == s); }
+    bool operator<(const String &s) const { return value < s.value; }
+    char operator[](unsigned int i) const { return i < value.size() ? value[i] : 0; }
+    char charAt(unsigned int i) const { return (*this)[i]; }
+
+    int indexOf(char c, unsigned int from = 0) const { return toIndex(value.find(c, from)); }
+    int indexOf(const String &s, unsigned int from = 0) const { return toIndex(value.find(s.value, from)); }
+    int lastIndexOf(char c) const { return toIndex(value.rfind(c)); }
+    String substring(unsigned int from) const { return from < value.size() ? String(value.substr(from)) : String(); }
+    String substring(unsigned int from, unsigned int to) const {
+      if (from > to) std::swap(from, to);
+      return from < value.size() ? String(value.substr(from, to - from)) : String();
+    }
+    bool startsWith(const String &s) const { return value.compare(0, s.value.size(), s.value) == 0; }
+    bool endsWith(const String &s) const {
+      return value.size() >= s.value.size() && value.compare(value.size() - s.value.size(), s.value.size(), s.value) == 0;
+    }
+    long toInt() const { return atol(value.c_str()); }
+    float toFloat() const { return atof(value.c_str()); }
+
+  private:
+    std::string value;
+
+    static int toIndex(size_t pos) { return pos == std::string::npos ? -1 : (int)pos; }
+};
+
+// Result of String concatenations, as in the Arduino core
+class StringSumHelper : public String {
+  public:
+    StringSumHelper(const String &s) : String(s) {}
+    StringSumHelper(const char * s) : String(s) {}
+};
+
+inline StringSumHelper operator+(const StringSumHelper &a, const String &b) { StringSumHelper r(a); r += b; return r; }
+inline StringSumHelper operator+(const StringSumHelper &a, const char * b) { StringSumHelper r(a); r += b; return r; }
+inline StringSumHelper operator+(const StringSumHelper &a, char b) { StringSumHelper r(a); r += b; return r; }
+
+// Output
+class Print;
+
+class Printable {
+  public:
+    virtual ~Printable() {}
+    virtual size_t printTo(Print &p) const = 0;
+};
+
+class Print {
+  public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t * buffer, size_t size) {
+      size_t n = 0;
+      while (size--) n += write(*buffer++);
+      return n;
+    }
+    size_t write(const char * s) { return s ? write((const uint8_t *)s, strlen(s)) : 0; }
+    size_t write(const char * s, size_t size) { return write((const uint8_t *)s, size); }
+
+    size_t print(const __FlashStringHelper * s) { return write(reinterpret_cast<const char *>(s)); }
+    size_t print(const String &s) { return write(s.c_str(), s.length()); }
+    size_t print(const char * s) { return write(s); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int n) { return printf("%d", n); }
+    size_t print(unsigned int n) { return printf("%u", n); }
+    size_t print(long n) { return printf("%ld", n); }
+    size_t print(unsigned long n) { return printf("%lu", n); }
+    size_t print(double n, int decimals = 2) { return printf("%.*f", decimals, n); }
+    size_t print(const Printable &p) { return p.printTo(*this); }
+
+    template <typename T>
+    size_t println(const T &value) { size_t n = print(value); return n + println(); }
+    size_t println() { return write("\r\n"); }
+
+    size_t printf(const char * format, ...) __attribute__((format(printf, 2, 3))) {
+      va_list arg;
+      va_start(arg, format);
+      int len = vsnprintf(nullptr, 0, format, arg);
+      va_end(arg);
+      if (len < 0) return 0;
+      std::string buffer(len + 1, '\0');
+      va_start(arg, format);
+      vsnprintf(&buffer[0], len + 1, format, arg);
+      va_end(arg);
+      return write(buffer.c_str(), len);
+    }
+};
+
+class Stream : public Print {
+  public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual void flush() {}
+};
+
+// Written to stdout, tests can silence it with logLevel
+class HardwareSerial : public Stream {
+  public:
+    void begin(unsigned long baud) {}
+    size_t write(uint8_t c) override { return fwrite(&c, 1, 1, stdout); }
+    size_t write(const uint8_t * buffer, size_t size) override { return fwrite(buffer, 1, size, stdout); }
+    using Print::write;
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+};
+
+inline HardwareSerial Serial;
+
+// FreeRTOS, tasks run as detached host threads. Blocking calls wait for the real host clock.
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) (ms)
+#define configMAX_TASK_NAME_LEN 16
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef void * TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+struct portMUX_TYPE {
+  std::recursive_mutex mutex;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+
+// Wait on cv until ready() is true, for at most ticks ms
+template <typename Ready>
+inline bool hostWait(std::unique_lock<std::mutex> &lock, std::condition_variable &cv, TickType_t ticks, Ready ready) {
+  if (ticks == portMAX_DELAY) {
+    cv.wait(lock, ready);
+    return true;
+  }
+  return cv.wait_for(lock, std::chrono::milliseconds(ticks), ready);
+}
+
+// Recursive mutex or binary semaphore
+struct HostSemaphore {
+  std::mutex mutex;
+  std::condition_variable cv;
+  bool recursive;
+  uint32_t count;                               // binary: 1 if given, mutex: recursion depth
+  std::thread::id owner;
+};
+typedef HostSemaphore * SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new HostSemaphore{ {}, {}, true, 0, {} }; }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new HostSemaphore{ {}, {}, false, 0, {} }; }
+inline void vSemaphoreDelete(SemaphoreHandle_t s) { delete s; }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(s->mutex);
+  std::thread::id self = std::this_thread::get_id();
+  if (s->recursive) {
+    if (!hostWait(lock, s->cv, ticks, [&] { return s->count == 0 || s->owner == self; })) return pdFALSE;
+    s->owner = self;
+    s->count++;
+  } else {
+    if (!hostWait(lock, s->cv, ticks, [&] { return s->count > 0; })) return pdFALSE;
+    s->count = 0;
+  }
+  return pdTRUE;
+}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t s) {
+  std::lock_guard<std::mutex> lock(s->mutex);
+  if (s->recursive) {
+    if (s->count == 0 || s->owner != std::this_thread::get_id()) return pdFALSE;
+    s->count--;
+  } else {
+    if (s->count) return pdFALSE;
+    s->count = 1;
+  }
+  s->cv.notify_all();
+  return pdTRUE;
+}
+
+// Queue of fixed size items, copied in and out as in FreeRTOS
+struct HostQueue {
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::deque<std::string> items;
+  UBaseType_t length;
+  UBaseType_t itemSize;
+};
+typedef HostQueue * QueueHandle_t;
+
+inline QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) { return new HostQueue{ {}, {}, {}, length, itemSize }; }
+inline void vQueueDelete(QueueHandle_t q) { delete q; }
+inline BaseType_t xQueueSend(QueueHandle_t q, const void * item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(q->mutex);
+  if (!hostWait(lock, q->cv, ticks, [&] { return q->items.size() < q->length; })) return pdFALSE;
+  q->items.emplace_back((const char *)item, q->itemSize);
+  q->cv.notify_all();
+  return pdTRUE;
+}
+inline BaseType_t xQueueReceive(QueueHandle_t q, void * item, TickType_t ticks) {
+  std::unique_lock<std::mutex> lock(q->mutex);
+  if (!hostWait(lock, q->cv, ticks, [&] { return !q->items.empty(); })) return pdFALSE;
+  memcpy(item, q->items.front().data(), q->itemSize);
+  q->items.pop_front();
+  q->cv.notify_all();
+  return pdTRUE;
+}
+
+// The task function returns on the host instead of deleting itself
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *, uint32_t, void * param, UBaseType_t, TaskHandle_t * handle, BaseType_t) {
+  std::thread task(fn, param);
+  if (handle) *handle = (TaskHandle_t)(uintptr_t)std::hash<std::thread::id>()(task.get_id());
+  task.detach();
+  return pdPASS;
+}
+inline BaseType_t xTaskCreate(TaskFunction_t fn, const char * name, uint32_t stack, void * param, UBaseType_t priority, TaskHandle_t * handle) {
+  return xTaskCreatePinnedToCore(fn, name, stack, param, priority, handle, tskNO_AFFINITY);
+}
+inline UBaseType_t uxTaskPriorityGet(TaskHandle_t) { return 1; }
+inline void vTaskDelete(TaskHandle_t) {}
+inline void vTaskDelay(TickType_t ticks) { delay(ticks); }
+
+#endif // ARDUINO_STANDIN_h
@@ -0,0 +1,39 @@
+/**
+ * @file Client.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Stand-in of the Arduino network client interface for host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef CLIENT_STANDIN_h
+#define CLIENT_STANDIN_h
+
+#include <Arduino.h>
+#include "IPAddress.h"
+
+class Client : public Stream {
+  public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char * host, uint16_t port) = 0;
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t * buffer, size_t size) = 0;
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int read(uint8_t * buffer, size_t size) = 0;
+    virtual int peek() = 0;
+    virtual void flush() = 0;
+    virtual void stop() = 0;
+    virtual uint8_t connected() = 0;
+    virtual operator bool() = 0;
+
+  protected:
+    uint8_t * rawIPAddress(IPAddress &address) { return address.raw_address(); }
+};
+
+#endif // CLIENT_STANDIN_h
@@ -0,0 +1,14 @@
+// Stand-in for host tests, the webserver is not available. The declarations
+// allow headers like webserial.h to be included, the classes can't be used.
+#ifndef ESPASYNCWEBSERVER_STANDIN_h
+#define ESPASYNCWEBSERVER_STANDIN_h
+
+#include <Arduino.h>
+
+class AsyncWebServer;
+class AsyncWebSocket;
+class AsyncWebSocketClient;
+class AsyncWebServerRequest;
+class AsyncWebServerResponse;
+
+#endif // ESPASYNCWEBSERVER_STANDIN_h
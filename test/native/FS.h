@@ -0,0 +1,186 @@
+/**
+ * @file FS.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief In-memory stand-in of the Arduino filesystem API for host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef FS_STANDIN_h
+#define FS_STANDIN_h
+
+#include <Arduino.h>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+namespace fs {
+
+enum SeekMode { SeekSet = 0, SeekCur = 1, SeekEnd = 2 };
+
+// Content of a filesystem, shared by all open files
+struct Storage {
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  std::set<std::string> dirs;
+  size_t capacity = 1536 * 1024;                // bytes, writes fail once all files together reach it
+
+  size_t used() const {
+    size_t n = 0;
+    for (auto &f : files) n += f.second->size();
+    return n;
+  }
+};
+
+class File : public Stream {
+  public:
+    File() {}
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t * buffer, size_t size) override {
+      if (!data || !writable) return 0;
+      size = min(size, storage->capacity - min(storage->capacity, storage->used()));
+      if (append) pos = data->size();
+      if (pos + size > data->size()) data->resize(pos + size);
+      memcpy(data->data() + pos, buffer, size);
+      pos += size;
+      return size;
+    }
+    using Print::write;
+
+    int available() override { return data ? data->size() - min(pos, data->size()) : 0; }
+    int read() override { return available() ? (*data)[pos++] : -1; }
+    int peek() override { return available() ? (*data)[pos] : -1; }
+    size_t read(uint8_t * buffer, size_t size) {
+      size = min(size, (size_t)available());
+      if (size) memcpy(buffer, data->data() + pos, size);
+      pos += size;
+      return size;
+    }
+    size_t readBytes(char * buffer, size_t size) { return read((uint8_t *)buffer, size); }
+    void flush() override {}
+
+    bool seek(uint32_t offset, SeekMode mode = SeekSet) {
+      if (!data) return false;
+      size_t base = mode == SeekSet ? 0 : (mode == SeekCur ? pos : data->size());
+      if (base + offset > data->size()) return false;
+      pos = base + offset;
+      return true;
+    }
+    size_t position() const { return pos; }
+    size_t size() const { return data ? data->size() : 0; }
+    void close() { *this = File(); }
+    operator bool() const { return data != nullptr || directory; }
+
+    const char * path() const { return filePath.c_str(); }
+    const char * name() const { return filePath.c_str(); }
+    bool isDirectory() const { return directory; }
+
+    // Next entry of a directory, in the order of the names
+    File openNextFile(const char * mode = FILE_READ) {
+      if (!directory) return File();
+      std::string prefix = filePath == "/" ? "/" : filePath + "/";
+      auto it = storage->files.upper_bound(lastEntry.empty() ? prefix : lastEntry);
+      for (; it != storage->files.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        if (it->first.find('/', prefix.size()) != std::string::npos) continue;
+        lastEntry = it->first;
+        return File(storage, it->first, it->second, mode);
+      }
+      lastEntry = "\xff";
+      return File();
+    }
+    void rewindDirectory() { lastEntry.clear(); }
+
+  private:
+    friend class FS;
+
+    std::shared_ptr<Storage> storage;
+    std::string filePath;
+    std::shared_ptr<std::vector<uint8_t>> data;
+    size_t pos = 0;
+    bool writable = false;
+    bool append = false;
+    bool directory = false;
+    std::string lastEntry;
+
+    File(std::shared_ptr<Storage> s, const std::string &path, std::shared_ptr<std::vector<uint8_t>> d, const char * mode)
+      : storage(s), filePath(path), data(d) {
+      writable = mode[0] != 'r' || mode[1] == '+';
+      append = mode[0] == 'a';
+      if (mode[0] == 'w') data->clear();
+    }
+};
+
+class FS {
+  public:
+    FS() : storage(std::make_shared<Storage>()) {}
+
+    File open(const char * path, const char * mode = FILE_READ, const bool create = false) {
+      std::string p = normalize(path);
+      if (storage->dirs.count(p)) {
+        File dir;
+        dir.storage = storage;
+        dir.filePath = p;
+        dir.directory = true;
+        return dir;
+      }
+      auto it = storage->files.find(p);
+      if (it == storage->files.end()) {
+        if (mode[0] == 'r' && !create) return File();
+        it = storage->files.emplace(p, std::make_shared<std::vector<uint8_t>>()).first;
+      }
+      return File(storage, p, it->second, mode);
+    }
+    File open(const String &path, const char * mode = FILE_READ, const bool create = false) { return open(path.c_str(), mode, create); }
+
+    bool exists(const char * path) { std::string p = normalize(path); return storage->files.count(p) || storage->dirs.count(p); }
+    bool exists(const String &path) { return exists(path.c_str()); }
+    bool remove(const char * path) { return storage->files.erase(normalize(path)) > 0; }
+    bool remove(const String &path) { return remove(path.c_str()); }
+    bool rename(const char * from, const char * to) {
+      auto it = storage->files.find(normalize(from));
+      if (it == storage->files.end()) return false;
+      auto data = it->second;
+      storage->files.erase(it);
+      storage->files[normalize(to)] = data;
+      return true;
+    }
+    bool rename(const String &from, const String &to) { return rename(from.c_str(), to.c_str()); }
+    bool mkdir(const char * path) { storage->dirs.insert(normalize(path)); return true; }
+    bool mkdir(const String &path) { return mkdir(path.c_str()); }
+    bool rmdir(const char * path) { return storage->dirs.erase(normalize(path)) > 0; }
+    bool rmdir(const String &path) { return rmdir(path.c_str()); }
+
+    // Test helpers
+    void clear() { storage = std::make_shared<Storage>(); storage->dirs.insert("/"); }
+    Storage &getStorage() { return *storage; }
+
+  protected:
+    std::shared_ptr<Storage> storage;
+
+    static std::string normalize(const char * path) {
+      std::string p = path[0] == '/' ? path : std::string("/") + path;
+      if (p.size() > 1 && p.back() == '/') p.pop_back();
+      return p;
+    }
+};
+
+} // namespace fs
+
+using fs::FS;
+using fs::File;
+using fs::SeekMode;
+using fs::SeekSet;
+using fs::SeekCur;
+using fs::SeekEnd;
+
+#endif // FS_STANDIN_h
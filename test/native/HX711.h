@@ -0,0 +1,72 @@
+/**
+ * @file HX711.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Stand-in of the HX711 library for host tests, raw values are provided per data pin
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef HX711_STANDIN_h
+#define HX711_STANDIN_h
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+
+class HX711 {
+  public:
+    // Simulated chip behind a data pin
+    struct Chip {
+      std::function<long()> source = [] { return 0L; };
+      bool ready = true;
+      uint32_t reads = 0;
+    };
+    static inline std::map<uint8_t, Chip> chips;
+
+    static void reset() { chips.clear(); }
+    static void setRaw(uint8_t dout, long value) { chips[dout].source = [value] { return value; }; }
+    static void setSource(uint8_t dout, std::function<long()> source) { chips[dout].source = source; }
+    static void setReady(uint8_t dout, bool ready) { chips[dout].ready = ready; }
+    static uint32_t getReads(uint8_t dout) { return chips[dout].reads; }
+
+    void begin(byte dout, byte pd_sck, byte gain = 128) { DOUT = dout; }
+    bool is_ready() { return chips[DOUT].ready; }
+    void wait_ready(unsigned long delay_ms = 0) {}
+    bool wait_ready_retry(int retries = 3, unsigned long delay_ms = 0) { return is_ready(); }
+    bool wait_ready_timeout(unsigned long timeout = 1000, unsigned long delay_ms = 0) { return is_ready(); }
+    void set_gain(byte gain = 128) {}
+    void power_down() {}
+    void power_up() {}
+
+    // Same calculation as the library
+    long read() {
+      Chip &chip = chips[DOUT];
+      chip.reads++;
+      return chip.source();
+    }
+    long read_average(byte times = 10) {
+      long sum = 0;
+      for (byte i = 0; i < times; i++) sum += read();
+      return sum / times;
+    }
+    double get_value(byte times = 1) { return read_average(times) - OFFSET; }
+    float get_units(byte times = 1) { return get_value(times) / SCALE; }
+    void tare(byte times = 10) { set_offset(read_average(times)); }
+
+    void set_scale(float scale = 1.f) { SCALE = scale; }
+    float get_scale() { return SCALE; }
+    void set_offset(long offset = 0) { OFFSET = offset; }
+    long get_offset() { return OFFSET; }
+
+  private:
+    byte DOUT = 0;
+    long OFFSET = 0;
+    float SCALE = 1;
+};
+
+#endif // HX711_STANDIN_h
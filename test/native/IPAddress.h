@@ -0,0 +1,50 @@
+/**
+ * @file IPAddress.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Stand-in of the Arduino IPv4 address for host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef IPADDRESS_STANDIN_h
+#define IPADDRESS_STANDIN_h
+
+#include <Arduino.h>
+
+class IPAddress : public Printable {
+  public:
+    IPAddress() {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+    IPAddress(uint32_t address) { memcpy(bytes, &address, 4); }
+
+    bool fromString(const char * address) {
+      unsigned int a, b, c, d;
+      char end;
+      if (sscanf(address, "%u.%u.%u.%u%c", &a, &b, &c, &d, &end) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+      *this = IPAddress(a, b, c, d);
+      return true;
+    }
+    bool fromString(const String &address) { return fromString(address.c_str()); }
+
+    operator uint32_t() const { uint32_t address; memcpy(&address, bytes, 4); return address; }
+    bool operator==(const IPAddress &other) const { return memcmp(bytes, other.bytes, 4) == 0; }
+    uint8_t operator[](int i) const { return bytes[i]; }
+    uint8_t * raw_address() { return bytes; }
+
+    String toString() const {
+      char buffer[16];
+      snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+      return String(buffer);
+    }
+    size_t printTo(Print &p) const override { return p.print(toString()); }
+
+  private:
+    uint8_t bytes[4] = {0, 0, 0, 0};
+};
+
+#endif // IPADDRESS_STANDIN_h
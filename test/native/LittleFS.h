@@ -0,0 +1,33 @@
+/**
+ * @file LittleFS.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief In-memory stand-in of LittleFS for host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef LITTLEFS_STANDIN_h
+#define LITTLEFS_STANDIN_h
+
+#include <FS.h>
+
+class LittleFSFS : public fs::FS {
+  public:
+    bool begin(bool formatOnFail = false, const char * basePath = "/littlefs", uint8_t maxOpenFiles = 10, const char * partitionLabel = "spiffs") {
+      storage->dirs.insert("/");
+      return true;
+    }
+    void end() {}
+    bool format() { clear(); return true; }
+    size_t totalBytes() { return storage->capacity; }
+    size_t usedBytes() { return storage->used(); }
+};
+
+inline LittleFSFS LittleFS;
+
+#endif // LITTLEFS_STANDIN_h
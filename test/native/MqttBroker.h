@@ -0,0 +1,148 @@
+/**
+ * @file MqttBroker.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Local MQTT 3.1.1 broker stand-in for host tests, reached through the WiFiClient stand-in
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * Packets are answered synchronously while the client writes them. Only the packets
+ * required by a publishing client are handled: CONNECT, PUBLISH, PINGREQ and DISCONNECT.
+ */
+
+#ifndef MQTTBROKER_STANDIN_h
+#define MQTTBROKER_STANDIN_h
+
+#include <Arduino.h>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+class MqttBroker {
+  public:
+    struct Message {
+      std::string topic;
+      std::string payload;
+      uint8_t qos;
+      bool retained;
+    };
+
+    std::vector<Message> messages;              // all received publishes
+    std::map<std::string, Message> retained;    // last retained message per topic
+    uint32_t connects = 0;
+    std::string clientId;
+    std::string user;
+    std::string pass;
+    uint8_t connackCode = 0;                    // 0 accepts, e.g. 5 refuses as not authorized
+    uint32_t session = 0;                       // increased on every connect or drop of the client
+    std::function<void(const Message &)> onPublish;   // called in the client for every PUBLISH, e.g. to stall it
+
+    MqttBroker(uint16_t port = 1883) : port(port) { brokers()[port] = this; }
+    ~MqttBroker() { brokers().erase(port); }
+
+    static MqttBroker * at(uint16_t port) {
+      auto it = brokers().find(port);
+      return it == brokers().end() ? nullptr : it->second;
+    }
+
+    // Close the connection of the current client, as if the network was lost
+    void dropClient() {
+      session++;
+      pending.clear();
+    }
+
+    // Called by the client for every written byte sequence, the answers are appended to reply
+    // Returns false if the client has to be disconnected
+    bool receive(const uint8_t * data, size_t len, std::deque<uint8_t> &reply) {
+      pending.insert(pending.end(), data, data + len);
+      for (;;) {
+        // fixed header with a variable length of up to 4 bytes
+        size_t pos = 1;
+        uint32_t remaining = 0;
+        for (uint32_t shift = 0; ; shift += 7) {
+          if (pos >= pending.size()) return true;
+          if (shift > 21) return false;
+          remaining |= (pending[pos] & 0x7f) << shift;
+          if (!(pending[pos++] & 0x80)) break;
+        }
+        if (pending.size() < pos + remaining) return true;
+
+        std::vector<uint8_t> packet(pending.begin() + pos, pending.begin() + pos + remaining);
+        uint8_t header = pending[0];
+        pending.erase(pending.begin(), pending.begin() + pos + remaining);
+        if (!handle(header, packet, reply)) return false;
+      }
+    }
+
+  private:
+    uint16_t port;
+    std::vector<uint8_t> pending;
+
+    static std::map<uint16_t, MqttBroker *> &brokers() {
+      static std::map<uint16_t, MqttBroker *> instances;
+      return instances;
+    }
+
+    static std::string readString(const std::vector<uint8_t> &p, size_t &pos) {
+      if (pos + 2 > p.size()) return std::string();
+      size_t len = p[pos] << 8 | p[pos + 1];
+      pos += 2;
+      if (pos + len > p.size()) len = p.size() - pos;
+      std::string s((const char *)p.data() + pos, len);
+      pos += len;
+      return s;
+    }
+
+    bool handle(uint8_t header, const std::vector<uint8_t> &p, std::deque<uint8_t> &reply) {
+      size_t pos = 0;
+      switch (header >> 4) {
+        case 1: {                                 // CONNECT
+          std::string protocol = readString(p, pos);
+          if (protocol != "MQTT" || pos + 4 > p.size()) return false;
+          uint8_t flags = p[pos + 1];
+          pos += 4;                               // level, flags, keep alive
+          clientId = readString(p, pos);
+          if (flags & 0x04) {                     // will topic and message
+            readString(p, pos);
+            readString(p, pos);
+          }
+          user = flags & 0x80 ? readString(p, pos) : std::string();
+          pass = flags & 0x40 ? readString(p, pos) : std::string();
+          connects++;
+          session++;
+          reply.insert(reply.end(), {0x20, 0x02, 0x00, connackCode});
+          return connackCode == 0;
+        }
+        case 3: {                                 // PUBLISH
+          Message m;
+          m.qos = (header >> 1) & 0x03;
+          m.retained = header & 0x01;
+          m.topic = readString(p, pos);
+          uint16_t id = 0;
+          if (m.qos && pos + 2 <= p.size()) {
+            id = p[pos] << 8 | p[pos + 1];
+            pos += 2;
+          }
+          m.payload.assign(p.begin() + pos, p.end());
+          if (onPublish) onPublish(m);
+          messages.push_back(m);
+          if (m.retained) retained[m.topic] = m;
+          if (m.qos == 1) reply.insert(reply.end(), {0x40, 0x02, (uint8_t)(id >> 8), (uint8_t)id});
+          return true;
+        }
+        case 12:                                  // PINGREQ
+          reply.insert(reply.end(), {0xd0, 0x00});
+          return true;
+        case 14:                                  // DISCONNECT
+        default:
+          return false;
+      }
+    }
+};
+
+#endif // MQTTBROKER_STANDIN_h
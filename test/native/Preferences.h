@@ -0,0 +1,112 @@
+/**
+ * @file Preferences.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief In-memory stand-in of the NVS Preferences for host tests, counts all accesses
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef PREFERENCES_STANDIN_h
+#define PREFERENCES_STANDIN_h
+
+#include <Arduino.h>
+#include <map>
+
+class Preferences {
+  public:
+    // Content of all namespaces, shared by all instances like the real NVS
+    static inline std::map<std::string, std::map<std::string, std::string>> storage;
+    static inline uint32_t opens = 0;
+    static inline uint32_t reads = 0;
+    static inline uint32_t writes = 0;
+    static inline std::string failKey;          // writes of this key fail, to test error handling
+
+    static void reset() {
+      storage.clear();
+      opens = reads = writes = 0;
+      failKey.clear();
+    }
+
+    bool begin(const char * name, bool readOnly = false) {
+      opens++;
+      if (readOnly && storage.find(name) == storage.end()) return false;
+      ns = &storage[name];
+      this->readOnly = readOnly;
+      return true;
+    }
+    void end() { ns = nullptr; }
+    bool clear() { if (ns && !readOnly) ns->clear(); return ns != nullptr && !readOnly; }
+    bool remove(const char * key) { return ns && !readOnly && ns->erase(key); }
+    bool isKey(const char * key) { return ns && ns->count(key); }
+
+    String getString(const char * key, const String defaultValue = String()) {
+      const std::string * v = read(key);
+      return v ? String(*v) : defaultValue;
+    }
+    bool getBool(const char * key, bool defaultValue = false) {
+      const std::string * v = read(key);
+      return v ? *v == "1" : defaultValue;
+    }
+    uint8_t getUChar(const char * key, uint8_t defaultValue = 0) { return getULong64(key, defaultValue); }
+    uint32_t getUInt(const char * key, uint32_t defaultValue = 0) { return getULong64(key, defaultValue); }
+    uint32_t getULong(const char * key, uint32_t defaultValue = 0) { return getULong64(key, defaultValue); }
+    uint64_t getULong64(const char * key, uint64_t defaultValue = 0) {
+      const std::string * v = read(key);
+      return v ? std::stoull(*v) : defaultValue;
+    }
+    double getDouble(const char * key, double defaultValue = NAN) {
+      const std::string * v = read(key);
+      return v ? std::stod(*v) : defaultValue;
+    }
+    size_t getBytesLength(const char * key) {
+      const std::string * v = read(key);
+      return v ? v->size() : 0;
+    }
+    size_t getBytes(const char * key, void * buffer, size_t len) {
+      const std::string * v = read(key);
+      if (!v || v->size() > len) return 0;
+      memcpy(buffer, v->data(), v->size());
+      return v->size();
+    }
+
+    size_t putString(const char * key, const String value) { return write(key, value.c_str()) ? value.length() : 0; }
+    size_t putBool(const char * key, bool value) { return write(key, value ? "1" : "0") ? 1 : 0; }
+    size_t putUChar(const char * key, uint8_t value) { return write(key, std::to_string(value)) ? 1 : 0; }
+    size_t putUInt(const char * key, uint32_t value) { return write(key, std::to_string(value)) ? 4 : 0; }
+    size_t putULong(const char * key, uint32_t value) { return write(key, std::to_string(value)) ? 4 : 0; }
+    size_t putULong64(const char * key, uint64_t value) { return write(key, std::to_string(value)) ? 8 : 0; }
+    size_t putDouble(const char * key, double value) {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "%.17g", value);
+      return write(key, buffer) ? 8 : 0;
+    }
+    size_t putBytes(const char * key, const void * value, size_t len) {
+      return write(key, std::string((const char *)value, len)) ? len : 0;
+    }
+
+  private:
+    std::map<std::string, std::string> * ns = nullptr;
+    bool readOnly = false;
+
+    const std::string * read(const char * key) {
+      reads++;
+      if (!ns) return nullptr;
+      auto it = ns->find(key);
+      return it == ns->end() ? nullptr : &it->second;
+    }
+
+    bool write(const char * key, const std::string &value) {
+      if (!ns || readOnly) return false;
+      if (failKey == key) return false;
+      writes++;
+      (*ns)[key] = value;
+      return true;
+    }
+};
+
+#endif // PREFERENCES_STANDIN_h
@@ -0,0 +1,2 @@
+// Stand-in for host tests, Stream is part of Arduino.h
+#include <Arduino.h>
@@ -0,0 +1,86 @@
+/**
+ * @file WiFi.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Stand-in of the WiFi client for host tests, connects to a MqttBroker on the same port
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef WIFI_STANDIN_h
+#define WIFI_STANDIN_h
+
+#include <Arduino.h>
+#include "Client.h"
+#include "IPAddress.h"
+#include "MqttBroker.h"
+
+class WiFiClient : public Client {
+  public:
+    static inline uint32_t bytesWritten = 0;    // by all clients, to measure the protocol overhead
+
+    int connect(IPAddress ip, uint16_t port) override { return open(port); }
+    int connect(const char * host, uint16_t port) override { return open(port); }
+
+    size_t write(uint8_t c) override { return write(&c, 1); }
+    size_t write(const uint8_t * buffer, size_t size) override {
+      MqttBroker * broker = current();
+      if (broker == nullptr) return 0;
+      bytesWritten += size;
+      if (!broker->receive(buffer, size, rx)) closed = true;
+      return size;
+    }
+    using Print::write;
+
+    int available() override { return rx.size(); }
+    int read() override {
+      if (rx.empty()) return -1;
+      uint8_t c = rx.front();
+      rx.pop_front();
+      return c;
+    }
+    int read(uint8_t * buffer, size_t size) override {
+      size = min(size, rx.size());
+      for (size_t i = 0; i < size; i++) buffer[i] = read();
+      return size;
+    }
+    int peek() override { return rx.empty() ? -1 : rx.front(); }
+    void flush() override {}
+    void stop() override {
+      port = 0;
+      rx.clear();
+    }
+    // Like a socket, received data can still be read after the broker closed the connection
+    uint8_t connected() override { return current() != nullptr || !rx.empty(); }
+    operator bool() override { return connected(); }
+
+  private:
+    uint16_t port = 0;
+    uint32_t session = 0;
+    bool closed = false;
+    std::deque<uint8_t> rx;
+
+    int open(uint16_t p) {
+      MqttBroker * broker = MqttBroker::at(p);
+      if (broker == nullptr) return 0;
+      port = p;
+      rx.clear();
+      closed = false;
+      // The broker starts a new session with the CONNECT packet
+      session = broker->session + 1;
+      return 1;
+    }
+
+    MqttBroker * current() {
+      if (port == 0 || closed) return nullptr;
+      MqttBroker * broker = MqttBroker::at(port);
+      if (broker == nullptr || broker->session > session) return nullptr;
+      return broker;
+    }
+};
+
+#endif // WIFI_STANDIN_h
@@ -0,0 +1,30 @@
+/**
+ * @file benchmark.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Micro benchmarks within the host tests, measured with the real host clock
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef BENCHMARK_h
+#define BENCHMARK_h
+
+#include <chrono>
+#include <cstdio>
+
+// Run fn the given number of times and print the average time per call, returns it in ns
+template <typename F>
+double benchmark(const char * name, uint32_t iterations, F fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < iterations; i++) fn();
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / iterations;
+  printf("[BENCHMARK] %s: %.1f ns/op (%u iterations)\n", name, ns, iterations);
+  return ns;
+}
+
+#endif // BENCHMARK_h
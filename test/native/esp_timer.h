@@ -0,0 +1,9 @@
+// Stand-in of the ESP-IDF high resolution timer for host tests, follows the host clock of Arduino.h
+#ifndef ESP_TIMER_STANDIN_h
+#define ESP_TIMER_STANDIN_h
+
+#include <Arduino.h>
+
+inline int64_t esp_timer_get_time() { return hostMicros(); }
+
+#endif // ESP_TIMER_STANDIN_h
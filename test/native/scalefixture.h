@@ -0,0 +1,53 @@
+/**
+ * @file scalefixture.h
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Calibrated scale on the HX711 and NVS stand-ins, shared by the host tests
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#ifndef SCALEFIXTURE_h
+#define SCALEFIXTURE_h
+
+#include <Preferences.h>
+#include <HX711.h>
+#include "scalemanager.h"
+
+#define DOUT 32
+#define NVS "gaslevels0"
+#define CAL_SCALE 20.0
+
+// Calibration of the test scale, the offset is up to the test
+class ScaleFixture {
+  public:
+    const long offset;
+
+    explicit ScaleFixture(long offset) : offset(offset) {}
+
+    // Raw HX711 value of a weight in gramms
+    long raw(uint32_t gramms) const { return offset + (long)(gramms * CAL_SCALE); }
+
+    // Store the calibration with an 11kg bottle, 5.5kg empty, in the NVS
+    void configure() const {
+      Preferences::storage[NVS]["scale"] = std::to_string(CAL_SCALE);
+      Preferences::storage[NVS]["offset"] = std::to_string(offset);
+      Preferences::storage[NVS]["emptyWeight"] = "5500";
+      Preferences::storage[NVS]["fullWeight"] = "16500";
+    }
+};
+
+// Scale on DOUT, configured from the NVS with the calibration of the fixture
+class CalibratedScale : public SCALEMANAGER {
+  public:
+    explicit CalibratedScale(const ScaleFixture &fixture) : SCALEMANAGER(DOUT, 27, 128) {
+      fixture.configure();
+      begin(NVS);
+    }
+};
+
+#endif // SCALEFIXTURE_h
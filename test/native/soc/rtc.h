@@ -0,0 +1,13 @@
+// Stand-in of the RTC slow clock for host tests. One tick is one microsecond of the host clock,
+// see esp_clk_slowclk_cal_get() in esp32/clk.h.
+#ifndef SOC_RTC_STANDIN_h
+#define SOC_RTC_STANDIN_h
+
+#include <Arduino.h>
+
+inline uint64_t rtc_time_get() { return hostMicros(); }
+
+// The calibration value is the period of a tick in microseconds, Q13.19 fixed point
+inline uint64_t rtc_time_slowclk_to_us(uint64_t ticks, uint32_t period) { return ticks * period >> 19; }
+
+#endif // SOC_RTC_STANDIN_h
@@ -0,0 +1,45 @@
+/**
+ * @file webserial.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Stand-in of the WebSerial log sink for host tests, the output is dropped
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include "webserial.h"
+
+WebSerialClass WebSerial;
+
+void WebSerialClass::begin(AsyncWebServer *server, const char* url) {}
+bool WebSerialClass::startBackgroundTask() { return false; }
+
+void WebSerialClass::print(int c) {}
+void WebSerialClass::print(uint8_t c) {}
+void WebSerialClass::print(uint16_t c) {}
+void WebSerialClass::print(uint32_t c) {}
+void WebSerialClass::print(long int c) {}
+void WebSerialClass::print(double c) {}
+void WebSerialClass::print(float c) {}
+void WebSerialClass::print(const char * c) {}
+void WebSerialClass::print(char * c) {}
+void WebSerialClass::print(String c) {}
+
+void WebSerialClass::println(int c) {}
+void WebSerialClass::println(uint8_t c) {}
+void WebSerialClass::println(uint16_t c) {}
+void WebSerialClass::println(uint32_t c) {}
+void WebSerialClass::println(long int c) {}
+void WebSerialClass::println(float c) {}
+void WebSerialClass::println(double c) {}
+void WebSerialClass::println(const char * c) {}
+void WebSerialClass::println(char * c) {}
+void WebSerialClass::println(String c) {}
+
+size_t WebSerialClass::printf(const char *format, ...) { return 0; }
+void WebSerialClass::write(const char * data, size_t len) {}
+void WebSerialClass::flush() {}
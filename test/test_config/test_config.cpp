@@ -0,0 +1,105 @@
+/**
+ * @file test_config.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests of the typed configuration against an in-memory NVS
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include "config.h"
+
+void setUp() {
+  Preferences::reset();
+  Config = ConfigClass();
+}
+
+void tearDown() {}
+
+void test_defaults_on_first_boot() {
+  Config.load();
+  TEST_ASSERT_EQUAL_STRING("gaslevel", Config.get().hostname.c_str());
+  TEST_ASSERT_EQUAL(1883, Config.get().mqttPort);
+  TEST_ASSERT_TRUE(Config.get().enableSoftAp);
+}
+
+void test_load_reads_each_key_once() {
+  Preferences::storage[CONFIG_NVS_NAMESPACE]["hostname"] = "camper";
+  Preferences::storage[CONFIG_NVS_NAMESPACE]["mqttPort"] = "8883";
+  Config.load();
+  TEST_ASSERT_EQUAL(1, Preferences::opens);
+  TEST_ASSERT_EQUAL(15, Preferences::reads);
+  TEST_ASSERT_EQUAL_STRING("camper", Config.get().hostname.c_str());
+  TEST_ASSERT_EQUAL(8883, Config.get().mqttPort);
+}
+
+void test_get_does_not_touch_nvs() {
+  Config.load();
+  uint32_t opens = Preferences::opens, reads = Preferences::reads;
+  for (int i = 0; i < 100; i++) TEST_ASSERT_FALSE(Config.get().mqttHost.isEmpty());
+  TEST_ASSERT_EQUAL(opens, Preferences::opens);
+  TEST_ASSERT_EQUAL(reads, Preferences::reads);
+}
+
+void test_invalid_stored_values_are_replaced() {
+  Preferences::storage[CONFIG_NVS_NAMESPACE]["hostname"] = "x";
+  Preferences::storage[CONFIG_NVS_NAMESPACE]["mqttPort"] = "0";
+  Config.load();
+  TEST_ASSERT_EQUAL_STRING("gaslevel", Config.get().hostname.c_str());
+  TEST_ASSERT_EQUAL(1883, Config.get().mqttPort);
+}
+
+void test_commit_writes_only_changed_keys() {
+  Config.load();
+  ConfigData updated = Config.get();
+  updated.mqttHost = "broker";
+  updated.enableMqtt = true;
+  String error;
+  TEST_ASSERT_TRUE(Config.commit(updated, error));
+  TEST_ASSERT_EQUAL(2, Preferences::writes);
+  TEST_ASSERT_EQUAL_STRING("broker", Preferences::storage[CONFIG_NVS_NAMESPACE]["mqttHost"].c_str());
+  TEST_ASSERT_EQUAL_STRING("broker", Config.get().mqttHost.c_str());
+}
+
+void test_commit_rejects_invalid_hostname() {
+  Config.load();
+  ConfigData updated = Config.get();
+  updated.hostname = "ab";
+  String error;
+  TEST_ASSERT_FALSE(Config.commit(updated, error));
+  TEST_ASSERT_EQUAL_STRING("Invalid hostname!", error.c_str());
+  TEST_ASSERT_EQUAL(0, Preferences::writes);
+  TEST_ASSERT_EQUAL_STRING("gaslevel", Config.get().hostname.c_str());
+}
+
+void test_commit_restores_on_write_failure() {
+  Preferences::storage[CONFIG_NVS_NAMESPACE]["hostname"] = "camper";
+  Config.load();
+  ConfigData updated = Config.get();
+  updated.hostname = "trailer";
+  updated.mqttHost = "broker";
+  Preferences::failKey = "mqttHost";
+  String error;
+  TEST_ASSERT_FALSE(Config.commit(updated, error));
+
+  TEST_ASSERT_EQUAL_STRING("camper", Preferences::storage[CONFIG_NVS_NAMESPACE]["hostname"].c_str());
+  TEST_ASSERT_EQUAL(0, Preferences::storage[CONFIG_NVS_NAMESPACE].count("mqttHost"));
+  TEST_ASSERT_EQUAL_STRING("camper", Config.get().hostname.c_str());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_defaults_on_first_boot);
+  RUN_TEST(test_load_reads_each_key_once);
+  RUN_TEST(test_get_does_not_touch_nvs);
+  RUN_TEST(test_invalid_stored_values_are_replaced);
+  RUN_TEST(test_commit_writes_only_changed_keys);
+  RUN_TEST(test_commit_rejects_invalid_hostname);
+  RUN_TEST(test_commit_restores_on_write_failure);
+  return UNITY_END();
+}
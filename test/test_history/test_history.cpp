@@ -0,0 +1,88 @@
+/**
+ * @file test_history.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests of the level history on the LittleFS stand-in
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include <LittleFS.h>
+#include "history.h"
+
+void setUp() {
+  LittleFS.format();
+  LittleFS.begin();
+}
+
+void tearDown() {}
+
+void test_records_are_rate_limited() {
+  HistoryClass history;
+  TEST_ASSERT_TRUE(history.begin(LittleFS));
+  hostClockAdvance(HISTORY_INTERVAL_MS);
+  history.add(0, 50, 5500);
+  history.add(0, 49, 5400);                     // within the interval
+  history.add(1, 20, 2200);                     // other scale
+  TEST_ASSERT_EQUAL(2, history.getNextIndex());
+
+  HistoryRecord records[4];
+  uint32_t index = 0;
+  TEST_ASSERT_EQUAL(2, history.read(index, records, 4));
+  TEST_ASSERT_EQUAL(0, records[0].scale);
+  TEST_ASSERT_EQUAL(50, records[0].level);
+  TEST_ASSERT_EQUAL(5500, records[0].gasWeight);
+  TEST_ASSERT_EQUAL(1, records[1].scale);
+}
+
+void test_segments_are_found_on_begin() {
+  HistoryClass history;
+  history.begin(LittleFS);
+  for (int i = 0; i < 1500; i++) {
+    hostClockAdvance(HISTORY_INTERVAL_MS);
+    history.add(0, i % 100, i);
+  }
+  TEST_ASSERT_TRUE(LittleFS.exists("/history/1.bin"));
+
+  HistoryClass restored;
+  restored.begin(LittleFS);
+  TEST_ASSERT_EQUAL(0, restored.getFirstIndex());
+  TEST_ASSERT_EQUAL(1500, restored.getNextIndex());
+
+  HistoryRecord record;
+  uint32_t index = 1200;
+  TEST_ASSERT_EQUAL(1, restored.read(index, &record, 1));
+  TEST_ASSERT_EQUAL(1200, record.gasWeight);
+}
+
+void test_oldest_segment_is_removed() {
+  HistoryClass history;
+  history.begin(LittleFS);
+  uint32_t total = HISTORY_SEGMENTS * HISTORY_SEGMENT_RECORDS + 1;
+  for (uint32_t i = 0; i < total; i++) {
+    hostClockAdvance(HISTORY_INTERVAL_MS);
+    history.add(0, 0, i);
+  }
+  TEST_ASSERT_FALSE(LittleFS.exists("/history/0.bin"));
+  TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS, history.getFirstIndex());
+
+  // Deleted records are skipped
+  HistoryRecord record;
+  uint32_t index = 0;
+  TEST_ASSERT_EQUAL(1, history.read(index, &record, 1));
+  TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS, index);
+  TEST_ASSERT_EQUAL(HISTORY_SEGMENT_RECORDS, record.gasWeight);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_records_are_rate_limited);
+  RUN_TEST(test_segments_are_found_on_begin);
+  RUN_TEST(test_oldest_segment_is_removed);
+  return UNITY_END();
+}
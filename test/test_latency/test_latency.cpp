@@ -0,0 +1,173 @@
+/**
+ * @file test_latency.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host test of the sample timing while the MQTT output stalls
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * Mirrors loop() and outputTask() of main.cpp: the sampling side runs SCALEMANAGER::loop()
+ * and writes a SeqLock snapshot, the output side hands it to publishLatest() as outputTask()
+ * does. Sampling waits with delay(), which only advances the host clock, so the timing is
+ * checked in host clock time and does not depend on the scheduler.
+ */
+
+#include <unity.h>
+#include <LittleFS.h>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include "scalemanager.h"
+#include "MQTTclient.h"
+#include "seqlock.h"
+#include "log.h"
+#include "scalefixture.h"
+
+#define INTERVAL_MS 200
+#define STALL_MS (2 * INTERVAL_MS)
+
+struct Snapshot {
+  uint32_t sensorValue;
+};
+
+// Publishes a snapshot the way publishStatus() does for a single scale
+static void publish(MQTTclient &mqtt, const Snapshot &status) {
+  mqtt.publish("/sensorValue1", String(status.sensorValue));
+}
+
+// Runs loop() until samples readings were taken, returns the host time of each reading in ms.
+// Without an output thread, every snapshot is published before the next sample.
+static std::vector<uint64_t> sample(SCALEMANAGER &scale, SeqLock<Snapshot> &snapshot, uint32_t samples, MQTTclient * mqtt) {
+  std::vector<uint64_t> times;
+  HX711::setSource(DOUT, [&times] {
+    uint64_t now = millis();
+    if (times.empty() || now - times.back() > INTERVAL_MS / 2) times.push_back(now);
+    return 1234L;
+  });
+
+  while (times.size() < samples) {
+    delay(scale.msUntilNextRead());
+    scale.loop();
+    snapshot.write({ scale.getLastMedian() });
+    if (mqtt) publish(*mqtt, { scale.getLastMedian() });
+  }
+  return times;
+}
+
+// Largest delay of a reading after its due time
+static uint64_t maxLateness(const std::vector<uint64_t> &times) {
+  uint64_t late = 0;
+  for (size_t i = 1; i < times.size(); i++) {
+    uint64_t gap = times[i] - times[i - 1];
+    if (gap > INTERVAL_MS) late = max(late, gap - INTERVAL_MS);
+  }
+  return late;
+}
+
+static void connect(MQTTclient &mqtt) {
+  enableMqtt = true;
+  mqtt.mqttClientId = "gaslevel-latency";
+  mqtt.prepare("127.0.0.1", 1883, "verges/gaslevel", "", "");
+  mqtt.connect();
+}
+
+void setUp() {
+  logLevel = LOG_LEVEL_NONE;
+  Preferences::reset();
+  HX711::reset();
+  LittleFS.format();
+  LittleFS.begin();
+}
+
+void tearDown() {}
+
+// Guards the test below, a stalled broker has to delay a single threaded loop
+void test_inline_publish_delays_sampling() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  connect(mqtt);
+  broker.onPublish = [](const MqttBroker::Message &) { delay(STALL_MS); };
+
+  SCALEMANAGER scale(DOUT, 27, 128);
+  scale.begin(NVS);
+  TEST_ASSERT_TRUE(scale.startRecording(LittleFS, RECORDING_DIR "/latency.bin", INTERVAL_MS));
+  SeqLock<Snapshot> snapshot;
+  std::vector<uint64_t> times = sample(scale, snapshot, 4, &mqtt);
+  scale.stopRecording();
+
+  printf("[LATENCY] inline publish: samples up to %llums late\n", (unsigned long long)maxLateness(times));
+  TEST_ASSERT_TRUE(maxLateness(times) >= STALL_MS - INTERVAL_MS);
+}
+
+void test_output_stall_keeps_sampling_on_schedule() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  connect(mqtt);
+
+  // The first publish blocks the output thread until all samples are taken
+  std::mutex gate;
+  std::condition_variable changed;
+  bool stalled = false, released = false;
+  broker.onPublish = [&](const MqttBroker::Message &) {
+    std::unique_lock<std::mutex> lock(gate);
+    if (released) return;
+    stalled = true;
+    changed.notify_all();
+    changed.wait(lock, [&] { return released; });
+  };
+
+  SCALEMANAGER scale(DOUT, 27, 128);
+  scale.begin(NVS);
+  TEST_ASSERT_TRUE(scale.startRecording(LittleFS, RECORDING_DIR "/latency.bin", INTERVAL_MS));
+  SeqLock<Snapshot> snapshot;
+  snapshot.write({ 0 });
+
+  // outputTask()
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> lastPublished{0};
+  std::thread output([&] {
+    Snapshot status;
+    uint32_t published = 0;
+    while (!done) {
+      if (publishLatest(snapshot, status, published, [&mqtt](const Snapshot &s) { publish(mqtt, s); })) lastPublished = published;
+      else std::this_thread::yield();
+    }
+  });
+  {
+    std::unique_lock<std::mutex> lock(gate);
+    changed.wait(lock, [&] { return stalled; });
+  }
+
+  std::vector<uint64_t> times = sample(scale, snapshot, 10, nullptr);
+  {
+    std::lock_guard<std::mutex> lock(gate);
+    released = true;
+  }
+  changed.notify_all();
+  Snapshot latest;
+  uint32_t written = snapshot.read(latest);
+  while (lastPublished != written) std::this_thread::yield();
+  done = true;
+  output.join();
+  scale.stopRecording();
+
+  printf("[LATENCY] output thread: samples up to %llums late, %u of %u published\n",
+    (unsigned long long)maxLateness(times), (uint32_t)broker.messages.size(), (uint32_t)times.size());
+  TEST_ASSERT_EQUAL(10, times.size());
+  TEST_ASSERT_TRUE(maxLateness(times) < STALL_MS - INTERVAL_MS);
+  // The stalled snapshot and the latest one, the samples in between are skipped
+  TEST_ASSERT_EQUAL(2, broker.messages.size());
+  TEST_ASSERT_EQUAL_STRING("0", broker.messages.front().payload.c_str());
+  TEST_ASSERT_EQUAL_STRING("1234", broker.messages.back().payload.c_str());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_inline_publish_delays_sampling);
+  RUN_TEST(test_output_stall_keeps_sampling_on_schedule);
+  return UNITY_END();
+}
@@ -0,0 +1,140 @@
+/**
+ * @file test_mqtt.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests and benchmarks of the MQTT client against a local broker stand-in
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include "MQTTclient.h"
+#include "metrics.h"
+#include "log.h"
+#include "benchmark.h"
+
+static void prepare(MQTTclient &mqtt, const char * host = "127.0.0.1", uint16_t port = 1883) {
+  mqtt.mqttClientId = "gaslevel-test";
+  mqtt.prepare(host, port, "verges/gaslevel", "user", "secret");
+}
+
+void setUp() {
+  logLevel = LOG_LEVEL_NONE;
+  enableMqtt = true;
+}
+
+void tearDown() {}
+
+void test_connect_with_credentials() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  mqtt.connect();
+  TEST_ASSERT_TRUE(mqtt.isConnected());
+  TEST_ASSERT_TRUE(mqtt.isReady());
+  TEST_ASSERT_EQUAL(1, broker.connects);
+  TEST_ASSERT_EQUAL_STRING("gaslevel-test", broker.clientId.c_str());
+  TEST_ASSERT_EQUAL_STRING("user", broker.user.c_str());
+  TEST_ASSERT_EQUAL_STRING("secret", broker.pass.c_str());
+}
+
+void test_connect_by_hostname() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt, "broker.local");
+  mqtt.connect();
+  TEST_ASSERT_TRUE(mqtt.isConnected());
+}
+
+void test_publish_below_topic() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  mqtt.connect();
+  uint32_t publishes = metricMqttPublishes.get();
+  TEST_ASSERT_TRUE(mqtt.publish("/level1", "42"));
+  TEST_ASSERT_TRUE(mqtt.publish("/airPressure", "1013.25", false));
+  TEST_ASSERT_EQUAL(publishes + 2, metricMqttPublishes.get());
+
+  TEST_ASSERT_EQUAL(2, broker.messages.size());
+  TEST_ASSERT_EQUAL_STRING("verges/gaslevel/level1", broker.messages[0].topic.c_str());
+  TEST_ASSERT_EQUAL_STRING("42", broker.messages[0].payload.c_str());
+  TEST_ASSERT_TRUE(broker.messages[0].retained);
+  TEST_ASSERT_FALSE(broker.messages[1].retained);
+  TEST_ASSERT_EQUAL(1, broker.retained.size());
+}
+
+void test_refused_connection() {
+  MqttBroker broker;
+  broker.connackCode = 5;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  mqtt.connect();
+  TEST_ASSERT_FALSE(mqtt.isConnected());
+  TEST_ASSERT_EQUAL(MQTT_CONNECT_UNAUTHORIZED, mqtt.client.state());
+}
+
+void test_publish_without_broker_fails() {
+  MQTTclient mqtt;
+  prepare(mqtt, "127.0.0.1", 1884);
+  mqtt.connect();
+  TEST_ASSERT_FALSE(mqtt.isConnected());
+  uint32_t failures = metricMqttPublishFailures.get();
+  TEST_ASSERT_FALSE(mqtt.publish("/level1", "42"));
+  TEST_ASSERT_EQUAL(failures + 1, metricMqttPublishFailures.get());
+}
+
+void test_reconnect_after_lost_connection() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  mqtt.connect();
+  broker.dropClient();
+  TEST_ASSERT_FALSE(mqtt.isConnected());
+  TEST_ASSERT_FALSE(mqtt.publish("/level1", "42"));
+
+  mqtt.connect();
+  TEST_ASSERT_TRUE(mqtt.isConnected());
+  TEST_ASSERT_TRUE(mqtt.publish("/level1", "42"));
+  TEST_ASSERT_EQUAL(2, broker.connects);
+  TEST_ASSERT_EQUAL(1, broker.messages.size());
+}
+
+void test_disabled_client_does_not_connect() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  enableMqtt = false;
+  mqtt.connect();
+  TEST_ASSERT_EQUAL(0, broker.connects);
+  TEST_ASSERT_FALSE(mqtt.isConnected());
+}
+
+void test_benchmark_publish() {
+  MqttBroker broker;
+  MQTTclient mqtt;
+  prepare(mqtt);
+  mqtt.connect();
+  uint32_t bytes = WiFiClient::bytesWritten;
+  const uint32_t n = 100000;
+  benchmark("MQTTclient::publish() of a level", n, [&] { mqtt.publish("/level1", "42"); });
+  printf("[BENCHMARK] %.1f bytes per publish\n", (double)(WiFiClient::bytesWritten - bytes) / n);
+  TEST_ASSERT_EQUAL(n, broker.messages.size());
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_connect_with_credentials);
+  RUN_TEST(test_connect_by_hostname);
+  RUN_TEST(test_publish_below_topic);
+  RUN_TEST(test_refused_connection);
+  RUN_TEST(test_publish_without_broker_fails);
+  RUN_TEST(test_reconnect_after_lost_connection);
+  RUN_TEST(test_disabled_client_does_not_connect);
+  RUN_TEST(test_benchmark_publish);
+  return UNITY_END();
+}
@@ -0,0 +1,208 @@
+/**
+ * @file test_otapipeline.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests and benchmarks of the OTA pipeline against the former single buffer download
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ *
+ * Both the network and the flash are simulated with real sleeps. The TCP window lets the
+ * single buffer loop overlap about one flash sector with the download as well, so the
+ * benchmark mainly guards against the pipeline being slower while it needs a quarter
+ * of the memory.
+ */
+
+#include <unity.h>
+#include <vector>
+#include "otaPipeline.h"
+#include "benchmark.h"
+
+#define IMAGE_SIZE (256 * 1024)
+#define NETWORK_BYTES_PER_MS 2048             // about 2MB/s over WiFi
+#define TCP_WINDOW 5760                       // data the lwIP stack receives without being read
+#define FLASH_SECTOR 4096
+#define FLASH_SECTOR_US 4000                  // erase and write of a sector, about 1MB/s
+
+typedef std::chrono::steady_clock Clock;
+
+// Body of an HTTP response with a fake image. Data arrives at the network rate as long as
+// it fits into the TCP window, a reader that does not read stalls the transfer.
+class HttpStandIn {
+  public:
+    HttpStandIn(const std::vector<uint8_t> &image) : image(image), last(Clock::now()) {}
+
+    bool connected() { return read < image.size(); }
+    int getSize() { return image.size(); }
+
+    size_t available() {
+      receive();
+      return received - read;
+    }
+
+    // Blocks until len bytes are read or the timeout ended, as Stream::readBytes()
+    size_t readBytes(uint8_t * buffer, size_t len) {
+      size_t count = 0;
+      auto timeout = Clock::now() + std::chrono::milliseconds(5000);
+      while (count < len && Clock::now() < timeout) {
+        size_t chunk = min(available(), len - count);
+        memcpy(buffer + count, image.data() + read, chunk);
+        read += chunk;
+        count += chunk;
+        if (count < len) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        if (read == image.size()) break;
+      }
+      return count;
+    }
+
+  private:
+    const std::vector<uint8_t> &image;
+    size_t received = 0;
+    size_t read = 0;
+    Clock::time_point last;
+    double pending = 0;
+
+    void receive() {
+      auto now = Clock::now();
+      pending += std::chrono::duration<double, std::milli>(now - last).count() * NETWORK_BYTES_PER_MS;
+      last = now;
+      size_t limit = min(image.size(), read + TCP_WINDOW);
+      if (received + (size_t)pending > limit) pending = limit - received;
+      received += (size_t)pending;
+      pending -= (size_t)pending;
+    }
+};
+
+// Update.write() stand-in, sleeps for every started flash sector
+class FlashStandIn {
+  public:
+    std::vector<uint8_t> content;
+    size_t failAt = SIZE_MAX;                 // write() fails once this many bytes were written
+
+    size_t write(uint8_t * data, size_t len) {
+      if (content.size() + len > failAt) return 0;
+      size_t sectors = (content.size() + len + FLASH_SECTOR - 1) / FLASH_SECTOR - (content.size() + FLASH_SECTOR - 1) / FLASH_SECTOR;
+      std::this_thread::sleep_for(std::chrono::microseconds(sectors * FLASH_SECTOR_US));
+      content.insert(content.end(), data, data + len);
+      return len;
+    }
+};
+
+static std::vector<uint8_t> image(size_t size = IMAGE_SIZE) {
+  std::vector<uint8_t> data(size);
+  for (size_t i = 0; i < size; i++) data[i] = i * 7919 >> 3;
+  return data;
+}
+
+// The download loop of OtaWebUpdater::updateFile() before the pipeline, with a 128KB buffer
+static size_t singleBufferDownload(HttpStandIn &http, FlashStandIn &flash) {
+  const size_t bufferAllocationLen = 128*1024;
+  std::vector<uint8_t> buffer(bufferAllocationLen);
+  int totalLength = http.getSize();
+  int len = totalLength;
+  size_t currentLength = 0;
+
+  while (http.connected() && (len > 0 || len == -1)) {
+    size_t size = http.available();
+    if (size) {
+      size_t readBufLen = http.readBytes(buffer.data(), min(size, bufferAllocationLen));
+      if (len > 0) len -= readBufLen;
+      flash.write(buffer.data(), readBufLen);
+      currentLength += readBufLen;
+      continue;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));   // delay(1) on the device
+  }
+  return currentLength;
+}
+
+// The loop of OtaWebUpdater::receiveFile()
+static bool pipelineDownload(HttpStandIn &http, FlashStandIn &flash, size_t &received) {
+  OtaPipeline pipeline;
+  if (!pipeline.begin([&flash](uint8_t * data, size_t len) { return flash.write(data, len) == len; })) return false;
+
+  size_t totalLength = http.getSize();
+  received = 0;
+  while (received < totalLength) {
+    uint8_t * buffer = pipeline.acquire();
+    if (buffer == NULL) break;
+    size_t wanted = min(pipeline.getBufferSize(), totalLength - received);
+    size_t readBufLen = http.readBytes(buffer, wanted);
+    pipeline.commit(readBufLen);
+    received += readBufLen;
+    if (readBufLen < wanted) break;
+  }
+  return pipeline.finish();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_pipeline_writes_the_image() {
+  std::vector<uint8_t> data = image(100 * 1024 + 123);
+  HttpStandIn http(data);
+  FlashStandIn flash;
+  size_t received;
+  TEST_ASSERT_TRUE(pipelineDownload(http, flash, received));
+  TEST_ASSERT_EQUAL(data.size(), received);
+  TEST_ASSERT_EQUAL(data.size(), flash.content.size());
+  TEST_ASSERT_TRUE(data == flash.content);
+}
+
+void test_writer_failure_aborts_the_download() {
+  std::vector<uint8_t> data = image();
+  HttpStandIn http(data);
+  FlashStandIn flash;
+  flash.failAt = 3 * OTA_PIPELINE_BUFFER_SIZE;
+  size_t received;
+  TEST_ASSERT_FALSE(pipelineDownload(http, flash, received));
+  TEST_ASSERT_EQUAL(3 * OTA_PIPELINE_BUFFER_SIZE, flash.content.size());
+  TEST_ASSERT_TRUE(received < data.size());
+}
+
+void test_finish_without_data() {
+  FlashStandIn flash;
+  OtaPipeline pipeline;
+  TEST_ASSERT_TRUE(pipeline.begin([&flash](uint8_t * data, size_t len) { return flash.write(data, len) == len; }));
+  TEST_ASSERT_NOT_NULL(pipeline.acquire());
+  TEST_ASSERT_TRUE(pipeline.finish());
+  TEST_ASSERT_EQUAL(0, pipeline.getWritten());
+  TEST_ASSERT_NULL(pipeline.acquire());
+}
+
+void test_benchmark_download() {
+  std::vector<uint8_t> data = image();
+  size_t single = 0, pipelined = 0;
+  bool written = true;
+
+  double singleNs = benchmark("single 128KB buffer download of 256KB", 3, [&] {
+    HttpStandIn http(data);
+    FlashStandIn flash;
+    single = singleBufferDownload(http, flash);
+  });
+  double pipelineNs = benchmark("OtaPipeline download of 256KB", 3, [&] {
+    HttpStandIn http(data);
+    FlashStandIn flash;
+    written = pipelineDownload(http, flash, pipelined) && written;
+  });
+  printf("[BENCHMARK] OtaPipeline takes %.0f%% of the single buffer time, %u instead of %u bytes of buffers\n",
+    pipelineNs * 100 / singleNs, OTA_PIPELINE_BUFFERS * OTA_PIPELINE_BUFFER_SIZE, 128 * 1024);
+
+  TEST_ASSERT_EQUAL(data.size(), single);
+  TEST_ASSERT_EQUAL(data.size(), pipelined);
+  TEST_ASSERT_TRUE(written);
+  TEST_ASSERT_TRUE(pipelineNs < singleNs * 1.1);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_pipeline_writes_the_image);
+  RUN_TEST(test_writer_failure_aborts_the_download);
+  RUN_TEST(test_finish_without_data);
+  RUN_TEST(test_benchmark_download);
+  return UNITY_END();
+}
@@ -0,0 +1,235 @@
+/**
+ * @file test_recording.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests and benchmarks of the raw sample recorder and the replay
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include <LittleFS.h>
+#include <vector>
+#include "scalemanager.h"
+#include "MQTTclient.h"
+#include "log.h"
+#include "benchmark.h"
+#include "scalefixture.h"
+
+#define PATH RECORDING_DIR "/scale1.bin"
+
+static const ScaleFixture fixture(100000L);
+
+struct Result {
+  uint32_t median;
+  uint8_t level;
+  uint32_t gas;
+};
+
+// Record samples of a slowly emptying bottle with noise, returns the live results
+static std::vector<Result> record(SCALEMANAGER &scale, uint32_t samples, uint32_t intervalMs = 1000) {
+  uint32_t n = 0;
+  HX711::setSource(DOUT, [&n] { return fixture.raw(16500 - n / 3) + (long)(n * 7919 % 801) - 400; });
+  std::vector<Result> live;
+  if (!scale.startRecording(LittleFS, PATH, intervalMs)) return live;
+
+  for (uint32_t i = 0; i < samples; i++) {
+    hostClockAdvance(intervalMs);
+    scale.loop();
+    live.push_back({ scale.getLastMedian(), scale.getLevel(), scale.getGasWeight() });
+    n++;
+  }
+  scale.stopRecording();
+  return live;
+}
+
+void setUp() {
+  logLevel = LOG_LEVEL_NONE;
+  Preferences::reset();
+  HX711::reset();
+  LittleFS.format();
+  LittleFS.begin();
+}
+
+void tearDown() {}
+
+void test_raw_values_are_packed_in_24_bit() {
+  RecordingSample sample;
+  const long values[] = { 0, 1, -1, 8388607, -8388608, 123456, -654321 };
+  for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) sample.setRaw(i, values[i]);
+  for (uint8_t i = 0; i < sizeof(values) / sizeof(values[0]); i++) TEST_ASSERT_EQUAL(values[i], sample.getRaw(i));
+  TEST_ASSERT_EQUAL(40, sizeof(RecordingSample));
+}
+
+void test_recording_stores_raw_readings() {
+  CalibratedScale scale(fixture);
+  scale.setEnvironment(21.5, 1013.2);
+  HX711::setRaw(DOUT, fixture.raw(11000));
+  TEST_ASSERT_TRUE(scale.startRecording(LittleFS, PATH, 1000));
+  TEST_ASSERT_TRUE(scale.isRecording());
+  for (int i = 0; i < 20; i++) {
+    HX711::setReady(DOUT, i != 7);              // a failed read is recorded as well
+    hostClockAdvance(1000);
+    scale.loop();
+  }
+  scale.stopRecording();
+  TEST_ASSERT_FALSE(scale.isRecording());
+
+  File file = LittleFS.open(PATH, FILE_READ);
+  TEST_ASSERT_EQUAL(sizeof(RecordingHeader) + 20 * sizeof(RecordingSample), file.size());
+  RecordingReader reader;
+  TEST_ASSERT_TRUE(reader.begin(file));
+  TEST_ASSERT_EQUAL(1000, reader.getHeader().intervalMs);
+  TEST_ASSERT_EQUAL(fixture.offset, reader.getHeader().offset);
+  TEST_ASSERT_EQUAL(5500, reader.getHeader().emptyWeight);
+
+  RecordingSample sample;
+  for (int i = 0; i < 20; i++) {
+    TEST_ASSERT_TRUE(reader.next(sample));
+    TEST_ASSERT_EQUAL((i + 1) * 1000, sample.time);
+    TEST_ASSERT_EQUAL(2150, sample.temperature);
+    TEST_ASSERT_EQUAL(10132, sample.pressure);
+    TEST_ASSERT_EQUAL(i == 7 ? 0 : RECORDING_RAW_COUNTS, sample.count);
+    if (sample.count) TEST_ASSERT_EQUAL(fixture.raw(11000), sample.getRaw(RECORDING_RAW_COUNTS - 1));
+  }
+  TEST_ASSERT_FALSE(reader.next(sample));
+}
+
+void test_buffered_samples_are_flushed() {
+  CalibratedScale scale(fixture);
+  TEST_ASSERT_TRUE(scale.startRecording(LittleFS, PATH, 1000));
+  hostClockAdvance(1000);
+  scale.loop();
+  TEST_ASSERT_EQUAL(sizeof(RecordingHeader), LittleFS.open(PATH, FILE_READ).size());
+  scale.flushRecording();
+  TEST_ASSERT_EQUAL(sizeof(RecordingHeader) + sizeof(RecordingSample), LittleFS.open(PATH, FILE_READ).size());
+  TEST_ASSERT_TRUE(scale.isRecording());
+}
+
+void test_recording_stops_at_size_limit() {
+  CalibratedScale scale(fixture);
+  record(scale, RECORDING_MAX_SIZE / sizeof(RecordingSample) + RECORDING_BUFFER_SAMPLES);
+  TEST_ASSERT_FALSE(scale.isRecording());
+  TEST_ASSERT_TRUE(LittleFS.open(PATH, FILE_READ).size() <= RECORDING_MAX_SIZE);
+}
+
+void test_recording_stops_at_given_size() {
+  CalibratedScale scale(fixture);
+  const size_t limit = 16 * 1024;
+  HX711::setRaw(DOUT, fixture.raw(11000));
+  TEST_ASSERT_TRUE(scale.startRecording(LittleFS, PATH, 1000, limit));
+  for (uint32_t i = 0; i < limit / sizeof(RecordingSample) + RECORDING_BUFFER_SAMPLES; i++) {
+    hostClockAdvance(1000);
+    scale.loop();
+  }
+  TEST_ASSERT_FALSE(scale.isRecording());
+  TEST_ASSERT_TRUE(LittleFS.open(PATH, FILE_READ).size() <= limit);
+
+  // No room for the header and a single buffer
+  TEST_ASSERT_FALSE(scale.startRecording(LittleFS, PATH, 1000, sizeof(RecordingHeader)));
+}
+
+void test_replay_matches_live_pipeline() {
+  CalibratedScale scale(fixture);
+  std::vector<Result> live = record(scale, 500);
+
+  // Without a sensor and NVS, the calibration comes from the recording
+  SCALEMANAGER replica;
+  File file = LittleFS.open(PATH, FILE_READ);
+  RecordingReader reader;
+  TEST_ASSERT_TRUE(reader.begin(file));
+  uint32_t i = 0, mismatches = 0;
+  uint32_t replayed = replica.replay(reader, [&](const RecordingSample &sample, SCALEMANAGER &result) {
+    const Result &expected = live[i++];
+    if (expected.median != result.getLastMedian() || expected.level != result.getLevel() || expected.gas != result.getGasWeight()) mismatches++;
+  });
+  TEST_ASSERT_EQUAL(500, replayed);
+  TEST_ASSERT_EQUAL(0, mismatches);
+  TEST_ASSERT_TRUE(replica.isConfigured());
+  TEST_ASSERT_EQUAL(live.back().level, replica.getLevel());
+}
+
+void test_replay_simulates_slower_interval() {
+  CalibratedScale scale(fixture);
+  record(scale, 100);
+
+  SCALEMANAGER replica;
+  File file = LittleFS.open(PATH, FILE_READ);
+  RecordingReader reader;
+  TEST_ASSERT_TRUE(reader.begin(file, 5000));
+  uint32_t lastTime = 0;
+  uint32_t replayed = replica.replay(reader, [&](const RecordingSample &sample, SCALEMANAGER &result) {
+    TEST_ASSERT_TRUE(lastTime == 0 || sample.time - lastTime == 5000);
+    lastTime = sample.time;
+  });
+  TEST_ASSERT_EQUAL(20, replayed);
+}
+
+void test_replay_to_mqtt() {
+  CalibratedScale scale(fixture);
+  record(scale, 50);
+
+  MqttBroker broker;
+  MQTTclient mqtt;
+  enableMqtt = true;
+  mqtt.mqttClientId = "gaslevel-replay";
+  mqtt.prepare("127.0.0.1", 1883, "verges/gaslevel", "", "");
+  mqtt.connect();
+
+  SCALEMANAGER replica;
+  File file = LittleFS.open(PATH, FILE_READ);
+  RecordingReader reader;
+  reader.begin(file);
+  replica.replay(reader, [&](const RecordingSample &sample, SCALEMANAGER &result) {
+    mqtt.publish("/level1", String(result.getLevel()));
+  });
+  TEST_ASSERT_EQUAL(50, broker.messages.size());
+  TEST_ASSERT_EQUAL_STRING(std::to_string(replica.getLevel()).c_str(), broker.retained["verges/gaslevel/level1"].payload.c_str());
+}
+
+void test_rejects_other_files() {
+  File file = LittleFS.open("/other.bin", FILE_WRITE);
+  file.print("no recording, but long enough for a header");
+  file.close();
+  file = LittleFS.open("/other.bin", FILE_READ);
+  RecordingReader reader;
+  TEST_ASSERT_FALSE(reader.begin(file));
+  RecordingSample sample;
+  TEST_ASSERT_FALSE(reader.next(sample));
+}
+
+void test_benchmark_replay() {
+  CalibratedScale scale(fixture);
+  const uint32_t n = 10000;                     // 2.8 hours at 1 second
+  record(scale, n);
+
+  uint32_t replayed = 0;
+  benchmark("SCALEMANAGER::replay() of 10000 samples", 10, [&] {
+    SCALEMANAGER replica;
+    File file = LittleFS.open(PATH, FILE_READ);
+    RecordingReader reader;
+    reader.begin(file);
+    replayed = replica.replay(reader, nullptr);
+  });
+  printf("[BENCHMARK] %u samples per replay, %u bytes per sample\n", replayed, (uint32_t)sizeof(RecordingSample));
+  TEST_ASSERT_EQUAL(n, replayed);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_raw_values_are_packed_in_24_bit);
+  RUN_TEST(test_recording_stores_raw_readings);
+  RUN_TEST(test_buffered_samples_are_flushed);
+  RUN_TEST(test_recording_stops_at_size_limit);
+  RUN_TEST(test_recording_stops_at_given_size);
+  RUN_TEST(test_replay_matches_live_pipeline);
+  RUN_TEST(test_replay_simulates_slower_interval);
+  RUN_TEST(test_replay_to_mqtt);
+  RUN_TEST(test_rejects_other_files);
+  RUN_TEST(test_benchmark_replay);
+  return UNITY_END();
+}
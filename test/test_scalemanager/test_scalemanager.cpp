@@ -0,0 +1,147 @@
+/**
+ * @file test_scalemanager.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests and benchmarks of the HX711 sampling and the level calculation
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include "scalemanager.h"
+#include "metrics.h"
+#include "log.h"
+#include "benchmark.h"
+#include "scalefixture.h"
+
+static const ScaleFixture fixture(8000000L);
+
+// Let the sampling interval pass and run the loop once
+static void sample(SCALEMANAGER &scale) {
+  hostClockAdvance(5000);
+  scale.loop();
+}
+
+void setUp() {
+  logLevel = LOG_LEVEL_NONE;
+  Preferences::reset();
+  HX711::reset();
+}
+
+void tearDown() {}
+
+void test_unconfigured_scale() {
+  SCALEMANAGER scale(DOUT, 27, 128);
+  scale.begin(NVS);
+  HX711::setRaw(DOUT, 1234);
+  sample(scale);
+  TEST_ASSERT_FALSE(scale.isConfigured());
+  TEST_ASSERT_EQUAL(1234, scale.getLastMedian());
+  TEST_ASSERT_EQUAL(0, scale.getLevel());
+}
+
+void test_level_of_bottle_weights() {
+  CalibratedScale scale(fixture);
+  TEST_ASSERT_TRUE(scale.isConfigured());
+
+  const struct { uint32_t weight; uint8_t level; uint32_t gas; } cases[] = {
+    { 0, 0, 0 },                                // no bottle
+    { 5500, 0, 0 },                             // empty
+    { 8250, 25, 2750 },
+    { 11000, 50, 5500 },
+    { 16500, 100, 11000 },                      // full
+    { 17000, 100, 11500 },                      // overfilled or something on the scale
+  };
+  for (auto &c : cases) {
+    HX711::setRaw(DOUT, fixture.raw(c.weight));
+    sample(scale);
+    TEST_ASSERT_EQUAL(c.weight, scale.getLastMedian());
+    TEST_ASSERT_EQUAL(c.level, scale.getLevel());
+    TEST_ASSERT_EQUAL(c.gas, scale.getGasWeight());
+  }
+}
+
+void test_abnormal_reading_is_ignored() {
+  CalibratedScale scale(fixture);
+  HX711::setRaw(DOUT, fixture.raw(16500 * 10 + 1));
+  sample(scale);
+  TEST_ASSERT_EQUAL(0, scale.getLastMedian());
+  TEST_ASSERT_EQUAL(0, scale.getLevel());
+}
+
+void test_readings_are_averaged() {
+  CalibratedScale scale(fixture);
+  int i = 0;
+  HX711::setSource(DOUT, [&i] { return fixture.raw(11000) + (i++ % 2 ? 400 : -400); });
+  sample(scale);
+  TEST_ASSERT_EQUAL(10, HX711::getReads(DOUT));
+  TEST_ASSERT_EQUAL(11000, scale.getLastMedian());
+  TEST_ASSERT_EQUAL(50, scale.getLevel());
+}
+
+void test_sensor_is_read_once_per_interval() {
+  CalibratedScale scale(fixture);
+  sample(scale);
+  uint32_t reads = HX711::getReads(DOUT);
+  scale.loop();
+  hostClockAdvance(1000);
+  scale.loop();
+  TEST_ASSERT_EQUAL(reads, HX711::getReads(DOUT));
+  TEST_ASSERT_UINT32_WITHIN(50, 4000, scale.msUntilNextRead());
+  hostClockAdvance(4000);
+  TEST_ASSERT_EQUAL(0, scale.msUntilNextRead());
+}
+
+void test_failed_read_keeps_the_last_level() {
+  CalibratedScale scale(fixture);
+  HX711::setRaw(DOUT, fixture.raw(11000));
+  sample(scale);
+  uint32_t failures = metricScaleReadFailures.get();
+  HX711::setReady(DOUT, false);
+  sample(scale);
+  TEST_ASSERT_EQUAL(failures + 1, metricScaleReadFailures.get());
+  TEST_ASSERT_EQUAL(50, scale.getLevel());
+}
+
+void test_json_config_is_stored() {
+  SCALEMANAGER scale(DOUT, 27, 128);
+  scale.begin(NVS);
+  TEST_ASSERT_TRUE(scale.putJsonConfig("{\"scale\":20,\"offset\":8000000,\"emptyWeight\":5000,\"fullWeight\":16000}"));
+  TEST_ASSERT_TRUE(scale.isConfigured());
+  TEST_ASSERT_EQUAL_STRING("5000", Preferences::storage[NVS]["emptyWeight"].c_str());
+  TEST_ASSERT_FALSE(scale.putJsonConfig("{\"scale\":20}"));
+
+  SCALEMANAGER restored(DOUT, 27, 128);
+  restored.begin(NVS);
+  TEST_ASSERT_EQUAL(5000, restored.getBottleEmptyWeight());
+  TEST_ASSERT_EQUAL(16000, restored.getBottleFullWeight());
+  HX711::setRaw(DOUT, fixture.raw(10500));
+  sample(restored);
+  TEST_ASSERT_EQUAL(50, restored.getLevel());
+}
+
+void test_benchmark_sampling() {
+  CalibratedScale scale(fixture);
+  uint32_t n = 0;
+  HX711::setSource(DOUT, [&n] { return fixture.raw(5500 + n++ % 11000); });
+  benchmark("SCALEMANAGER::loop() with a due read of 10 samples", 100000, [&] { sample(scale); });
+  benchmark("SCALEMANAGER::loop() without a due read", 1000000, [&] { scale.loop(); });
+  TEST_ASSERT_TRUE(scale.getLevel() <= 100);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_unconfigured_scale);
+  RUN_TEST(test_level_of_bottle_weights);
+  RUN_TEST(test_abnormal_reading_is_ignored);
+  RUN_TEST(test_readings_are_averaged);
+  RUN_TEST(test_sensor_is_read_once_per_interval);
+  RUN_TEST(test_failed_read_keeps_the_last_level);
+  RUN_TEST(test_json_config_is_stored);
+  RUN_TEST(test_benchmark_sampling);
+  return UNITY_END();
+}
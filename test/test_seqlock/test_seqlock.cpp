@@ -0,0 +1,89 @@
+/**
+ * @file test_seqlock.cpp
+ * @author Martin Verges <martin@verges.cc>
+ * @brief Host tests and benchmarks of the SeqLock between the sampling and the output core
+ * @version 0.1
+ * @date 2023-02-18
+ *
+ * @copyright Copyright (c) 2022 by the author alone
+ *            https://gitlab.womolin.de/martin.verges/gaslevel
+ *
+ * License: CC BY-NC-SA 4.0
+ */
+
+#include <unity.h>
+#include <thread>
+#include "seqlock.h"
+#include "benchmark.h"
+
+// Every field holds the same value, a torn read mixes two of them
+struct Snapshot {
+  uint32_t values[16];
+};
+
+static Snapshot make(uint32_t v) {
+  Snapshot s;
+  for (auto &value : s.values) value = v;
+  return s;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_read_before_and_after_write() {
+  SeqLock<Snapshot> lock;
+  Snapshot s = make(7);
+  TEST_ASSERT_EQUAL(0, lock.read(s));
+  lock.write(make(1));
+  lock.write(make(2));
+  TEST_ASSERT_EQUAL(2, lock.read(s));
+  TEST_ASSERT_EQUAL(2, s.values[0]);
+  TEST_ASSERT_EQUAL(2, s.values[15]);
+}
+
+void test_no_torn_reads() {
+  SeqLock<Snapshot> lock;
+  lock.write(make(0));
+  std::atomic<bool> done{false};
+  std::atomic<uint32_t> written{0};
+  std::thread writer([&] {
+    for (uint32_t i = 1; !done; i++) {
+      lock.write(make(i));
+      written = i;
+    }
+  });
+
+  // Start reading once the writer is running
+  while (written == 0) {}
+  uint32_t torn = 0, lastWrites = 0, backwards = 0;
+  for (uint32_t reads = 0; reads < 1000000; reads++) {
+    Snapshot s;
+    uint32_t writes = lock.read(s);
+    for (auto value : s.values) if (value != s.values[0]) torn++;
+    if (s.values[0] + 1 != writes) torn++;      // value and counter belong together
+    if (writes < lastWrites) backwards++;
+    lastWrites = writes;
+  }
+  done = true;
+  writer.join();
+  printf("[SEQLOCK] %u writes during the reads\n", written.load());
+  TEST_ASSERT_EQUAL(0, torn);
+  TEST_ASSERT_EQUAL(0, backwards);
+}
+
+void test_benchmark_seqlock() {
+  SeqLock<Snapshot> lock;
+  Snapshot s = make(1);
+  uint32_t i = 0;
+  benchmark("SeqLock::write() of 64 bytes", 10000000, [&] { lock.write(make(i++)); });
+  benchmark("SeqLock::read() of 64 bytes", 10000000, [&] { lock.read(s); });
+  TEST_ASSERT_EQUAL(i - 1, s.values[0]);
+}
+
+int main(int argc, char **argv) {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_before_and_after_write);
+  RUN_TEST(test_no_torn_reads);
+  RUN_TEST(test_benchmark_seqlock);
+  return UNITY_END();
+}
@@ -20,9 +20,13 @@ import os
 import stat
 import sys
 from sys import platform, path
+from SCons.Script import COMMAND_LINE_TARGETS
 
 Import("env")
 
+sys.path.append(os.path.join(env.get("PROJECT_DIR"), "tools"))
+import webui_assets
+
 if not os.path.exists("tools/mklittlefs"):
     file =  env.get("PROJECT_DIR") + "/tools/build_littlefs_tool.sh"
     st = os.stat(file)
@@ -58,3 +62,11 @@ elif platform == "win32":
     print("[WARN] No automatic UI build for this platform", file=sys.stderr)
 
 env.Replace(MKFSTOOL=file)
+
+# Store the UI build gzip compressed with a content hash manifest (assets.json)
+# in the data_dir, from where the littlefs.bin is created.
+if any(target in COMMAND_LINE_TARGETS for target in ("buildfs", "uploadfs", "uploadfsota")):
+    webui_assets.write_littlefs_tree(
+        os.path.join(env.get("PROJECT_DIR"), "ui", "build"),
+        env.subst("$PROJECT_DATA_DIR")
+    )
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+#
+# Create a delta patch to update a running firmware to a new firmware.bin
+#
+# The bsdiff output is converted into a streaming format, where control, diff and extra data
+# are interleaved, so the sensor can apply it with a few KB of RAM while downloading.
+#
+# Patch format (all numbers little endian):
+#   header:  "GLPD", u8 version, 3 bytes reserved, u32 source size, u32 source crc32, u32 target size
+#   records: u32 diff length, u32 extra length, i32 seek, diff bytes, extra bytes
+#
+# The diff bytes are added to the source at the current position, the extra bytes are copied.
+# Afterwards the source position moves by the seek value.
+#
+# The diff bytes are mostly zeros and only small after compression. With an outfile ending in .gz
+# the patch is written gzip compressed, the sensor inflates it while downloading. No patch is
+# written if it would not be clearly smaller than the compressed firmware, the sensors then
+# download the firmware itself.
+#
+# Requires: pip3 install bsdiff4
+
+import argparse
+import bz2
+import gzip
+import struct
+import sys
+import zlib
+
+try:
+    import bsdiff4
+except ImportError:
+    sys.exit("[ERROR] Missing python module, please run: pip3 install bsdiff4")
+
+MAGIC = b'GLPD'
+VERSION = 1
+MAX_RATIO = 0.9   # compressed patch size relative to the compressed firmware
+
+
+def offtin(buf):
+    """Decode the sign-magnitude 64 bit integer used by bsdiff"""
+    value = int.from_bytes(buf[0:7], 'little') | ((buf[7] & 0x7F) << 56)
+    return -value if buf[7] & 0x80 else value
+
+
+def bsdiff_records(patch):
+    """Split a BSDIFF40 patch into (diff, extra, seek) records"""
+    if patch[0:8] != b'BSDIFF40':
+        sys.exit("[ERROR] Unexpected bsdiff patch format")
+    ctrl_len = offtin(patch[8:16])
+    diff_len = offtin(patch[16:24])
+    ctrl = bz2.decompress(patch[32:32 + ctrl_len])
+    diff = bz2.decompress(patch[32 + ctrl_len:32 + ctrl_len + diff_len])
+    extra = bz2.decompress(patch[32 + ctrl_len + diff_len:])
+
+    diff_pos = extra_pos = 0
+    for i in range(0, len(ctrl), 24):
+        x, y, z = offtin(ctrl[i:i+8]), offtin(ctrl[i+8:i+16]), offtin(ctrl[i+16:i+24])
+        yield diff[diff_pos:diff_pos + x], extra[extra_pos:extra_pos + y], z
+        diff_pos += x
+        extra_pos += y
+
+
+def create_patch(source, target):
+    out = bytearray(MAGIC)
+    out += struct.pack('<B3xIII', VERSION, len(source), zlib.crc32(source), len(target))
+    for diff, extra, seek in bsdiff_records(bsdiff4.diff(source, target)):
+        out += struct.pack('<IIi', len(diff), len(extra), seek)
+        out += diff
+        out += extra
+    return bytes(out)
+
+
+def apply_patch(source, patch):
+    """Reference implementation of the decoder, used to verify the result"""
+    version, source_size, source_crc, target_size = struct.unpack_from('<B3xIII', patch, 4)
+    if patch[0:4] != MAGIC or version != VERSION or source_size != len(source) or source_crc != zlib.crc32(source):
+        raise ValueError("patch does not match the source")
+    target = bytearray()
+    pos, old = 20, 0
+    while pos < len(patch):
+        diff_len, extra_len, seek = struct.unpack_from('<IIi', patch, pos)
+        pos += 12
+        for i in range(diff_len):
+            src = source[old + i] if 0 <= old + i < len(source) else 0
+            target.append((patch[pos + i] + src) & 0xFF)
+        pos += diff_len
+        target += patch[pos:pos + extra_len]
+        pos += extra_len
+        old += diff_len + seek
+    if len(target) != target_size:
+        raise ValueError("unexpected target size")
+    return bytes(target)
+
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-s', '--source', help="Firmware currently running on the sensors",
+                    action='store', metavar='<firmware.bin>', required=True)
+parser.add_argument('-t', '--target', help="New firmware to install",
+                    action='store', metavar='<firmware.bin>', required=True)
+parser.add_argument('-o', '--outfile', help="Filename of the patch",
+                    action='store', metavar='<filename>', required=True)
+args = vars(parser.parse_args())
+
+with open(args['source'], 'rb') as f:
+    source = f.read()
+with open(args['target'], 'rb') as f:
+    target = f.read()
+
+patch = create_patch(source, target)
+if apply_patch(source, patch) != target:
+    sys.exit("[ERROR] Verification of the patch failed")
+
+compressed = args['outfile'].endswith('.gz')
+data = gzip.compress(patch, 9, mtime=0) if compressed else patch
+firmware_size = len(gzip.compress(target, 9, mtime=0)) if compressed else len(target)
+if len(data) > MAX_RATIO * firmware_size:
+    print("[WARN] Patch with %d bytes is not smaller than the firmware with %d bytes, skipped" % (len(data), firmware_size))
+    sys.exit(0)
+
+with open(args['outfile'], 'wb') as out:
+    out.write(data)
+print("Write patch to %s (%d bytes, %.1f%% of %d bytes%s)" % (
+    args['outfile'], len(data), 100.0 * len(data) / max(firmware_size, 1), firmware_size,
+    ", both gzip compressed" if compressed else ""))
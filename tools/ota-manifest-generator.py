@@ -0,0 +1,72 @@
+#!/usr/bin/env python3
+#
+# Add sizes and SHA-256 digests of the images to current-version.json and optionally sign it
+#
+# The sensor verifies the digest of the written image before switching the boot partition.
+# With a signing key, current-version.json.sig is created, a detached signature of the exact
+# bytes of current-version.json. Firmware built with the matching public key refuses unsigned
+# or modified manifests.
+#
+# Create a key pair:   openssl ecparam -name prime256v1 -genkey -noout -out ota-signing-key.pem
+# Public key header:   ota-manifest-generator.py -k ota-signing-key.pem --public-header src/otaPublicKey.h
+# Sign a release:      ota-manifest-generator.py -k ota-signing-key.pem -d results
+
+import argparse
+import hashlib
+import json
+import os
+import subprocess
+import sys
+
+IMAGES = ['firmware.bin', 'littlefs.bin']
+
+parser = argparse.ArgumentParser()
+parser.add_argument('-d', '--directory', help="Directory with the images and current-version.json",
+                    action='store', metavar='<folder>')
+parser.add_argument('-k', '--key', help="PEM encoded private key to sign the manifest",
+                    action='store', metavar='<key.pem>')
+parser.add_argument('--public-header', help="Write the public key of --key as C header for the firmware",
+                    action='store', metavar='<otaPublicKey.h>')
+args = vars(parser.parse_args())
+
+
+def openssl(*params, data=None):
+    result = subprocess.run(['openssl'] + list(params), input=data, stdout=subprocess.PIPE)
+    if result.returncode != 0:
+        sys.exit("[ERROR] openssl %s failed" % params[0])
+    return result.stdout
+
+
+if args['public_header']:
+    if not args['key']:
+        sys.exit("[ERROR] --public-header requires a key")
+    pem = openssl('pkey', '-in', args['key'], '-pubout').decode()
+    lines = ''.join('  "%s\\n"\n' % line for line in pem.strip().splitlines())
+    with open(args['public_header'], 'w') as out:
+        out.write("// Generated by tools/ota-manifest-generator.py, do not edit\n")
+        out.write("#define OTA_PUBLIC_KEY \\\n%s" % lines.rstrip('\n').replace('\n', ' \\\n') + '\n')
+    print("Write public key to %s" % args['public_header'])
+
+if args['directory']:
+    manifestFile = os.path.join(args['directory'], 'current-version.json')
+    with open(manifestFile) as f:
+        manifest = json.load(f)
+
+    manifest['files'] = {}
+    for image in IMAGES:
+        path = os.path.join(args['directory'], image)
+        if not os.path.isfile(path):
+            sys.exit("[ERROR] Unable to open %s" % path)
+        with open(path, 'rb') as f:
+            data = f.read()
+        manifest['files'][image] = {'size': len(data), 'sha256': hashlib.sha256(data).hexdigest()}
+
+    content = json.dumps(manifest, indent=4).encode()
+    with open(manifestFile, 'wb') as out:
+        out.write(content)
+    print("Write manifest to %s" % manifestFile)
+
+    if args['key']:
+        with open(manifestFile + '.sig', 'wb') as out:
+            out.write(openssl('dgst', '-sha256', '-sign', args['key'], data=content))
+        print("Write signature to %s.sig" % manifestFile)
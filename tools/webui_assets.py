@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Helper to prepare the Svelte UI build (ui/build) for the ESP32.
+# ===============================================================
+# Every asset gets a content hash that is used as the HTTP ETag by
+# the firmware. Compressible assets are stored gzip compressed, so
+# the webserver can send them as they are with "Content-Encoding: gzip".
+#
+# All files below /_app/immutable/ carry a hash in their name and
+# are therefore served with an "immutable" cache header.
+# ===============================================================
+
+import gzip
+import hashlib
+import json
+import os
+import shutil
+
+MANIFEST_NAME = "assets.json"
+IMMUTABLE_PREFIX = "/_app/immutable/"
+NO_COMPRESS = (".png", ".jpg", ".jpeg", ".gif", ".ico", ".woff", ".woff2", ".gz", ".br", ".zip")
+MIN_COMPRESS_SIZE = 256
+
+class WebAsset:
+    def __init__(self, path, data):
+        self.path = path
+        self.data = data
+        self.etag = hashlib.sha256(data).hexdigest()[:20]
+        self.immutable = path.startswith(IMMUTABLE_PREFIX)
+        self.gzip = None
+
+        if len(data) >= MIN_COMPRESS_SIZE and not path.lower().endswith(NO_COMPRESS):
+            compressed = gzip.compress(data, compresslevel=9, mtime=0)
+            if len(compressed) < len(data):
+                self.gzip = compressed
+
+    def payload(self):
+        return self.gzip if self.gzip is not None else self.data
+
+def collect_assets(source_dir):
+    """Read all files from source_dir and return them sorted by their URL path"""
+    if not os.path.isdir(source_dir):
+        raise FileNotFoundError("UI build directory %s not found, please run 'npm run build' in ui/ first" % source_dir)
+
+    assets = []
+    for root, dirs, files in os.walk(source_dir):
+        dirs.sort()
+        for name in sorted(files):
+            if name.endswith((".gz", ".br")) or name == MANIFEST_NAME:
+                continue # precompressed variants of the UI build or our own output
+            file = os.path.join(root, name)
+            path = "/" + os.path.relpath(file, source_dir).replace(os.sep, "/")
+            with open(file, "rb") as f:
+                assets.append(WebAsset(path, f.read()))
+    assets.sort(key=lambda asset: asset.path)
+    return assets
+
+def manifest(assets):
+    """Build the manifest that is used by the firmware to look up ETags and cache policies"""
+    return {
+        "version": 1,
+        "files": {
+            asset.path: {
+                "etag": asset.etag,
+                "gzip": asset.gzip is not None,
+                "immutable": asset.immutable
+            } for asset in assets
+        }
+    }
+
+def write_littlefs_tree(source_dir, dest_dir):
+    """Write the (compressed) assets and the manifest to the LittleFS staging directory"""
+    assets = collect_assets(source_dir)
+
+    if os.path.isdir(dest_dir):
+        shutil.rmtree(dest_dir)
+    os.makedirs(dest_dir)
+
+    rawSize = 0
+    storedSize = 0
+    for asset in assets:
+        file = os.path.join(dest_dir, asset.path.lstrip("/")) + (".gz" if asset.gzip is not None else "")
+        os.makedirs(os.path.dirname(file), exist_ok=True)
+        with open(file, "wb") as f:
+            f.write(asset.payload())
+        rawSize += len(asset.data)
+        storedSize += len(asset.payload())
+
+    with open(os.path.join(dest_dir, MANIFEST_NAME), "w") as f:
+        json.dump(manifest(assets), f, separators=(",", ":"), sort_keys=True)
+
+    print("UI assets: %d files, %d bytes raw, %d bytes stored" % (len(assets), rawSize, storedSize))
+    return assets
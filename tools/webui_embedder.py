@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+
+# Embed the web UI into the firmware image
+# ===============================================================
+# Enabled with "custom_webui_embedded = yes" in the environment.
+# It converts ui/build into a generated header with gzip blobs and
+# a sorted path index, so the firmware can serve the UI straight
+# from the mapped flash without any LittleFS access.
+# ===============================================================
+
+import mimetypes
+import os
+import sys
+
+Import("env")
+
+sys.path.append(os.path.join(env.get("PROJECT_DIR"), "tools"))
+import webui_assets
+
+if env.GetProjectOption("custom_webui_embedded", "no").lower() in ("yes", "true", "1"):
+    source = os.path.join(env.get("PROJECT_DIR"), "ui", "build")
+    outdir = os.path.join(env.subst("$BUILD_DIR"), "webui")
+    header = os.path.join(outdir, "webui_embedded.h")
+
+    mimetypes.add_type("application/javascript", ".js")
+    mimetypes.add_type("application/json", ".json")
+    mimetypes.add_type("image/svg+xml", ".svg")
+    mimetypes.add_type("font/woff2", ".woff2")
+
+    assets = webui_assets.collect_assets(source)
+
+    lines = [
+        "// Generated by tools/webui_embedder.py from ui/build, do not edit!",
+        "#pragma once",
+        "",
+        "#include \"webui.h\"",
+        "",
+    ]
+    for i, asset in enumerate(assets):
+        payload = asset.payload()
+        lines.append("static const uint8_t WEBUI_ASSET_%d[] PROGMEM = {" % i)
+        for offset in range(0, len(payload), 20):
+            lines.append("  " + ",".join("0x%02x" % b for b in payload[offset:offset + 20]) + ",")
+        lines.append("};")
+
+    lines.append("")
+    lines.append("// Sorted by path, required for the binary search in WebUiHandler::find()")
+    lines.append("static constexpr WebAsset WEBUI_ASSETS[] = {")
+    for i, asset in enumerate(assets):
+        contentType = mimetypes.guess_type(asset.path)[0] or "application/octet-stream"
+        lines.append("  { \"%s\", \"%s\", \"%s\", WEBUI_ASSET_%d, %d, %s, %s }," % (
+            asset.path, asset.etag, contentType, i, len(asset.payload()),
+            "true" if asset.gzip is not None else "false",
+            "true" if asset.immutable else "false"
+        ))
+    lines.append("};")
+    lines.append("static constexpr size_t WEBUI_ASSET_COUNT = %d;" % len(assets))
+    lines.append("")
+    content = "\n".join(lines)
+
+    # Only touch the header if the UI changed, otherwise every build would recompile webui.cpp
+    if not os.path.isfile(header) or open(header).read() != content:
+        os.makedirs(outdir, exist_ok=True)
+        with open(header, "w") as f:
+            f.write(content)
+        print("Embedded %d UI assets with %d bytes into %s" % (len(assets), sum(len(a.payload()) for a in assets), header))
+
+    env.Append(CPPPATH=[outdir], CPPDEFINES=[("WEBUI_EMBEDDED", 1)])
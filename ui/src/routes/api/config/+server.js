@@ -4,6 +4,7 @@ import { error } from '@sveltejs/kit';
 export function GET() {
 	let responseBody = {
 		enableBle: true,
+		enableBleBroadcast: true,
 		enableDac: false,
 		enableMqtt: true,
 		enableSoftAp: true,
@@ -27,6 +28,7 @@ export async function POST({ request }) {
 
 	if (
 		!Object.prototype.hasOwnProperty.call(data, 'enableBle') ||
+		!Object.prototype.hasOwnProperty.call(data, 'enableBleBroadcast') ||
 		!Object.prototype.hasOwnProperty.call(data, 'enableDac') ||
 		!Object.prototype.hasOwnProperty.call(data, 'enableMqtt') ||
 		!Object.prototype.hasOwnProperty.call(data, 'enableSoftAp') ||